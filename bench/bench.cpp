@@ -0,0 +1,284 @@
+#include "../src/core/editor.hpp"
+#include "stats.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Micro-benchmarks of the headless core over synthetic documents.
+//
+//   build/bench [--max-size SIZE] [--ops N] [--journal-ops N] [--dir PATH]
+//
+// SIZE accepts K, M and G suffixes (default 1G). Every document is generated once
+// with short (80 column) lines and once with very long (1 MB) lines. Crash recovery is
+// measured separately, on a journal of 1000 edits, which is replayed as piece table
+// edits, and on one of --journal-ops edits (default 1M), which is replayed off-thread.
+
+struct BenchOptions {
+    size_t               maxSize;
+    size_t               ops;
+    size_t               journalOps;
+    String               dir;
+};
+
+size_t bench_parse_size(const char* text) {
+    char*  end   = nullptr;
+    size_t value = strtoull(text, &end, 10);
+    switch (*end) {
+        case 'k': case 'K': return value << 10;
+        case 'm': case 'M': return value << 20;
+        case 'g': case 'G': return value << 30;
+        default:            return value;
+    }
+}
+
+String bench_format_size(size_t size) {
+    if (size >= (1 << 30)) return std::to_string(size >> 30) + "G";
+    if (size >= (1 << 20)) return std::to_string(size >> 20) + "M";
+    if (size >= (1 << 10)) return std::to_string(size >> 10) + "K";
+    return std::to_string(size);
+}
+
+// Writes `size` bytes of printable text broken every `lineLength` bytes.
+bool bench_generate(const String& path, size_t size, size_t lineLength) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+
+    String chunk;
+    chunk.reserve(1 << 20);
+    size_t written = 0;
+    size_t column  = 0;
+    while (written < size) {
+        chunk.clear();
+        while (chunk.size() < (1 << 20) && written + chunk.size() < size) {
+            chunk.push_back(column + 1 == lineLength ? '\n' : (char)('a' + (written + chunk.size()) % 26));
+            column = column + 1 == lineLength ? 0 : column + 1;
+        }
+        if (write(fd, chunk.data(), chunk.size()) != (ssize_t)chunk.size()) {
+            close(fd);
+            return false;
+        }
+        written += chunk.size();
+    }
+    return close(fd) == 0;
+}
+
+void bench_wait_index(Buffer& buffer) {
+    while (buffer.indexer) {
+        buffer_poll_line_index(buffer);
+        std::this_thread::yield();
+    }
+}
+
+void bench_place_cursor(Buffer& buffer, std::mt19937_64& random) {
+    buffer_move_cursor_to_offset(buffer, random() % (buffer.text.size + 1));
+}
+
+typedef void (*BenchEdit)(Buffer& buffer);
+
+void bench_insert(Buffer& buffer) {
+    buffer_insert_char(buffer, 'x');
+}
+
+void bench_edit(Samples& samples, Buffer& buffer, const BenchOptions& options, std::mt19937_64& random, BenchEdit edit) {
+    for (size_t op = 0; op < options.ops; op++) {
+        bench_place_cursor(buffer, random);
+        Clock::time_point start = Clock::now();
+        edit(buffer);
+        samples.nanos.push_back(bench_elapsed(start));
+    }
+}
+
+void bench_cursor(Samples& samples, Buffer& buffer, const BenchOptions& options, std::mt19937_64& random) {
+    const BenchEdit moves[] = { &buffer_cursor_move_left, &buffer_cursor_move_right, &buffer_cursor_move_up, &buffer_cursor_move_down };
+    bench_place_cursor(buffer, random);
+    for (size_t op = 0; op < options.ops; op++) {
+        BenchEdit move = moves[random() % 4];
+        Clock::time_point start = Clock::now();
+        move(buffer);
+        buffer_follow_cursor(buffer);
+        samples.nanos.push_back(bench_elapsed(start));
+    }
+}
+
+// Lays out one full viewport, as a frame would, at random scroll positions.
+void bench_layout(Samples& samples, Buffer& buffer, const BenchOptions& options, std::mt19937_64& random) {
+    Vector<PlacedGlyph> glyphs;
+    for (size_t op = 0; op < options.ops; op++) {
+        bench_place_cursor(buffer, random);
+        buffer_clear_line_widths(buffer);
+        Clock::time_point start = Clock::now();
+        buffer_follow_cursor(buffer);
+        size_t lastLine = std::min(buffer.text.lineCount, buffer.scroll.y + buffer_visible_lines(buffer));
+        for (size_t line = buffer.scroll.y; line < lastLine; line++) {
+            buffer_layout_line(buffer, line, glyphs);
+        }
+        buffer_cursor_x(buffer);
+        samples.nanos.push_back(bench_elapsed(start));
+    }
+}
+
+void bench_save(Samples& samples, Buffer& buffer, const String& path, size_t rounds) {
+    String message;
+    buffer.name = path;
+    for (size_t round = 0; round < rounds; round++) {
+        Clock::time_point start = Clock::now();
+        save(buffer);
+        buffer_wait_save(buffer);
+        buffer_poll_save(buffer, message);
+        samples.nanos.push_back(bench_elapsed(start));
+        samples.bytes += buffer.text.size + 1;
+    }
+    if (buffer.savedVersion != buffer.text.version) {
+        fprintf(stderr, "save failed: %s\n", message.c_str());
+    }
+}
+
+void bench_document(const BenchOptions& options, size_t size, size_t lineLength, const char* shape) {
+    String document = bench_format_size(size) + "/" + shape;
+    String path     = options.dir + "/dc-bench-" + bench_format_size(size) + "-" + shape + ".txt";
+    String output   = path + ".out";
+    if (!bench_generate(path, size, lineLength)) {
+        fprintf(stderr, "could not write %s: %s\n", path.c_str(), strerror(errno));
+        return;
+    }
+
+    Buffer buffer;
+    buffer_initialize(buffer);
+    std::mt19937_64 random(size ^ lineLength);
+
+    Samples open     = { "open",    {}, 0 };
+    Samples index    = { "index",   {}, 0 };
+    Clock::time_point start = Clock::now();
+    if (!buffer_open_file(buffer, path)) {
+        fprintf(stderr, "could not open %s: %s\n", path.c_str(), strerror(errno));
+        return;
+    }
+    open.nanos.push_back(bench_elapsed(start));
+    bench_wait_index(buffer);
+    index.nanos.push_back(bench_elapsed(start));
+    index.bytes = size;
+
+    Samples cursor  = { "cursor",  {}, 0 };
+    Samples layout  = { "layout",  {}, 0 };
+    Samples insert  = { "insert",  {}, 0 };
+    Samples erase   = { "delete",  {}, 0 };
+    Samples newline = { "newline", {}, 0 };
+    Samples written = { "save",    {}, 0 };
+    bench_cursor(cursor, buffer, options, random);
+    bench_layout(layout, buffer, options, random);
+    bench_edit(insert,  buffer, options, random, &bench_insert);
+    bench_edit(erase,   buffer, options, random, &buffer_delete_char);
+    bench_edit(newline, buffer, options, random, &buffer_add_new_line);
+    bench_save(written, buffer, output, size >= (256 << 20) ? 1 : 3);
+
+    Samples* all[] = { &open, &index, &cursor, &layout, &insert, &erase, &newline, &written };
+    for (Samples* samples : all) {
+        bench_report(document, *samples);
+    }
+
+    buffer_close_file(buffer);
+    unlink(path.c_str());
+    unlink(output.c_str());
+}
+
+// Journals an editing session of `ops` edits (typing and backspacing in runs,
+// with a jump every 40 edits or so) on a 1 MB document, then times reopening the
+// document and replaying the journal.
+void bench_recover(const BenchOptions& options, size_t ops) {
+    const size_t size = 1 << 20;
+    String document = bench_format_size(ops) + "/journal";
+    String path     = options.dir + "/dc-bench-recover.txt";
+    if (!bench_generate(path, size, 80)) {
+        fprintf(stderr, "could not write %s: %s\n", path.c_str(), strerror(errno));
+        return;
+    }
+
+    Buffer buffer;
+    buffer_initialize(buffer);
+    if (!buffer_open_file(buffer, path)) {
+        fprintf(stderr, "could not open %s: %s\n", path.c_str(), strerror(errno));
+        return;
+    }
+
+    Samples append  = { "journal", {}, 0 };
+    Samples recover = { "recover", {}, 0 };
+    std::mt19937_64 random(ops);
+    size_t length = buffer.text.size;
+    size_t cursor = 0;
+    Journal journal;
+    journal_start(journal, journal_path(path), buffer.disk, 0);
+    for (size_t op = 0; op < ops; op++) {
+        if (random() % 40 == 0) cursor = random() % (length + 1);
+
+        char c = (char)('a' + random() % 26);
+        Clock::time_point start = Clock::now();
+        if (cursor > 0 && random() % 8 == 0) {
+            journal_erase(journal, --cursor, 1);
+            length--;
+        } else {
+            journal_insert(journal, cursor++, &c, 1);
+            length++;
+        }
+        append.nanos.push_back(bench_elapsed(start));
+    }
+    journal_stop(journal, false);
+    buffer_close_file(buffer);
+
+    String message;
+    buffer_initialize(buffer);
+    Clock::time_point start = Clock::now();
+    buffer_open_file(buffer, path);
+    buffer_recover(buffer, message);
+    while (buffer_is_recovering(buffer)) {
+        usleep(100);
+        buffer_poll_recovery(buffer, message);
+    }
+    recover.nanos.push_back(bench_elapsed(start));
+    recover.bytes = size;
+    if (buffer.text.size != length) {
+        fprintf(stderr, "recovery failed: %s\n", message.c_str());
+    }
+
+    bench_report(document, append);
+    bench_report(document, recover);
+    buffer_close_file(buffer);
+    unlink(path.c_str());
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    options.maxSize = 1 << 30;
+    options.ops        = 2000;
+    options.journalOps = 1000000;
+    options.dir        = "/tmp";
+
+    for (int idx = 1; idx + 1 < argc; idx += 2) {
+        if (strcmp(argv[idx], "--max-size") == 0) {
+            options.maxSize = bench_parse_size(argv[idx + 1]);
+        } else if (strcmp(argv[idx], "--ops") == 0) {
+            options.ops = std::max<size_t>(1, strtoull(argv[idx + 1], nullptr, 10));
+        } else if (strcmp(argv[idx], "--journal-ops") == 0) {
+            options.journalOps = std::max<size_t>(1, strtoull(argv[idx + 1], nullptr, 10));
+        } else if (strcmp(argv[idx], "--dir") == 0) {
+            options.dir = argv[idx + 1];
+        } else {
+            fprintf(stderr, "usage: %s [--max-size SIZE] [--ops N] [--journal-ops N] [--dir PATH]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("%-12s %-10s %8s %10s %10s %10s %10s  %15s\n", "document", "operation", "samples", "p50 us", "p90 us", "p99 us", "max us", "throughput");
+    const size_t sizes[] = { (size_t)1 << 10, (size_t)64 << 10, (size_t)1 << 20, (size_t)16 << 20, (size_t)256 << 20, (size_t)1 << 30 };
+    for (size_t size : sizes) {
+        if (size > options.maxSize) break;
+        bench_document(options, size, 80, "short");
+        bench_document(options, size, 1 << 20, "long");
+    }
+    bench_recover(options, 1000);
+    bench_recover(options, options.journalOps);
+    return EXIT_SUCCESS;
+}
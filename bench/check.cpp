@@ -0,0 +1,211 @@
+#include "../src/core/editor.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <random>
+#include <unistd.h>
+
+// Consistency checks of the headless core.
+//
+//   build/check [--ops N] [--seed N]
+//
+// Highlighting: makes N random edits (typing, deleting, newlines, pasted fragments,
+// undo and redo) to a C++ buffer, collecting highlight jobs at random points in between
+// as a frame would, and after each round of edits waits for the highlighter to catch up
+// and compares its result, line by line, with lexing the whole text from the top.
+//
+// Startup recovery: edits, saves and edits the startup buffer again, abandons its
+// journal as a crash would, and expects a new editor to bring every edit back.
+
+const char* const CHECK_PATH = "/tmp/dc-check.cpp";
+const size_t CHECK_ROUND     = 64;
+
+// Fragments that open or close every multi-line lexer state, so edits keep moving them.
+const char* const CHECK_FRAGMENTS[] = {
+    "/*", "*/", "//", "\"", "'", "\\", "\\\n", "#define X ", "#include <a>\n",
+    "int", "return 0;", "0x1f", "3.5f", "R\"(", ")\"", "{\n", "}\n", "\n\n", " ",
+};
+
+const char* const CHECK_SEED =
+    "#include <cstdio>\n"
+    "\n"
+    "/* A block comment\n"
+    "   spanning lines */\n"
+    "#define TWICE(x) \\\n"
+    "    ((x) * 2)\n"
+    "\n"
+    "int main(int argc, char** argv) {\n"
+    "    const char* text = \"a \\\"quoted\\\" string\";\n"
+    "    char c = '\\n';  // trailing comment\n"
+    "    return TWICE(argc) + 0x10 + 1.5e3;\n"
+    "}\n";
+
+struct CheckOptions {
+    size_t               ops;
+    uint64_t             seed;
+};
+
+void check_edit(Buffer& buffer, std::mt19937_64& random) {
+    buffer_move_cursor_to_offset(buffer, random() % (buffer.text.size + 1));
+    switch (random() % 8) {
+        case 0:  buffer_delete_char(buffer);  break;
+        case 1:  buffer_add_new_line(buffer); break;
+        case 2:  buffer_undo(buffer);         break;
+        case 3:  buffer_redo(buffer);         break;
+        case 4: {
+            const char* fragment = CHECK_FRAGMENTS[random() % (sizeof(CHECK_FRAGMENTS) / sizeof(*CHECK_FRAGMENTS))];
+            buffer_insert_text(buffer, fragment, strlen(fragment));
+            break;
+        }
+        default: buffer_insert_char(buffer, "/*\"'\\#x "[random() % 8]); break;
+    }
+}
+
+void check_wait_highlight(Buffer& buffer) {
+    while (buffer.highlight.job || buffer.highlight.dirtyFrom != SIZE_MAX) {
+        buffer_poll_highlight(buffer);
+        usleep(100);
+    }
+}
+
+// Relexes every line from the top and compares states and spans; false at the first
+// difference, which is reported.
+bool check_highlight(const Buffer& buffer, size_t op) {
+    const HighlightResult* result = buffer.highlight.result.get();
+    if (result == nullptr || result->version != buffer.text.version || result->states.size() != buffer.text.lineCount) {
+        fprintf(stderr, "op %zu: highlight of version %zu has %zu lines, text at version %zu has %zu\n", op,
+                result ? result->version : 0, result ? result->states.size() : 0, buffer.text.version, buffer.text.lineCount);
+        return false;
+    }
+
+    uint8_t state = 0;
+    String  line;
+    Vector<HighlightSpan> spans;
+    for (size_t idx = 0; idx < buffer.text.lineCount; idx++) {
+        line.clear();
+        text_for_each_chunk(buffer.text, text_line_start(buffer.text, idx), text_line_end(buffer.text, idx), [&](const char* data, size_t length) {
+            line.append(data, length);
+        });
+        spans.clear();
+        state = buffer.highlight.language->lexLine(state, line.data(), line.size(), spans);
+
+        size_t count;
+        const HighlightSpan* incremental = highlight_line_spans(buffer.highlight, idx, count);
+        bool same = result->states[idx] == state && count == spans.size();
+        for (size_t span = 0; same && span < count; span++) {
+            same = incremental[span].column == spans[span].column && incremental[span].length == spans[span].length
+                && incremental[span].kind == spans[span].kind;
+        }
+        if (!same) {
+            fprintf(stderr, "op %zu: line %zu \"%s\" differs from a full relex (state %d, expected %d)\n", op, idx,
+                    line.c_str(), result->states[idx], state);
+            return false;
+        }
+    }
+    return true;
+}
+
+String check_text(const Buffer& buffer) {
+    String text;
+    text_for_each_chunk(buffer.text, 0, buffer.text.size, [&](const char* data, size_t length) {
+        text.append(data, length);
+    });
+    return text;
+}
+
+// Runs in a directory of its own, since the startup buffer is named relative to it.
+bool check_startup_recovery() {
+    char directory[] = "/tmp/dc-check-XXXXXX";
+    if (mkdtemp(directory) == nullptr || chdir(directory) != 0) {
+        fprintf(stderr, "startup recovery: no directory to run in: %s\n", strerror(errno));
+        return false;
+    }
+
+    String message;
+    Editor editor;
+    editor_initialize(editor);
+    editor_open_startup_buffer(editor, message);
+    Buffer& buffer = editor_current(editor);
+    buffer_insert_text(buffer, "saved\n", 6);
+    save(buffer);
+    buffer_wait_save(buffer);
+    buffer_poll_save(buffer, message);
+    buffer_insert_text(buffer, "journaled", 9);
+
+    // A crash leaves the journal behind.
+    String expected = check_text(buffer);
+    journal_stop(*buffer.journal, false);
+    buffer.journal.reset();
+    editor_close(editor);
+
+    Editor restarted;
+    editor_initialize(restarted);
+    message.clear();
+    editor_open_startup_buffer(restarted, message);
+    Buffer& recovered = editor_current(restarted);
+    while (buffer_is_recovering(recovered)) {
+        usleep(100);
+        buffer_poll_recovery(recovered, message);
+    }
+
+    String text   = check_text(recovered);
+    bool   passed = text == expected;
+    if (!passed) {
+        fprintf(stderr, "startup recovery: expected \"%s\", got \"%s\" (%s)\n", expected.c_str(), text.c_str(), message.c_str());
+    }
+    editor_close(restarted);
+
+    String journal = journal_path(recovered.name);
+    unlink(recovered.name.c_str());
+    unlink(journal.c_str());
+    unlink((journal + ".stale").c_str());
+    rmdir(directory);
+    return passed;
+}
+
+int main(int argc, char** argv) {
+    CheckOptions options;
+    options.ops  = 20000;
+    options.seed = 1;
+
+    for (int idx = 1; idx + 1 < argc; idx += 2) {
+        if (strcmp(argv[idx], "--ops") == 0) {
+            options.ops = strtoull(argv[idx + 1], nullptr, 10);
+        } else if (strcmp(argv[idx], "--seed") == 0) {
+            options.seed = strtoull(argv[idx + 1], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--ops N] [--seed N]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    Buffer buffer;
+    buffer_initialize(buffer);
+    buffer.name               = CHECK_PATH;
+    buffer.highlight.language = highlight_language_for(CHECK_PATH);
+    buffer_insert_text(buffer, CHECK_SEED, strlen(CHECK_SEED));
+
+    std::mt19937_64 random(options.seed);
+    bool   passed = true;
+    size_t checks = 0;
+    for (size_t op = 0; op < options.ops && passed; op++) {
+        check_edit(buffer, random);
+        if (random() % 4 == 0) buffer_poll_highlight(buffer);
+        if (op % CHECK_ROUND == CHECK_ROUND - 1 || op + 1 == options.ops) {
+            check_wait_highlight(buffer);
+            passed = check_highlight(buffer, op);
+            checks++;
+        }
+    }
+
+    printf("highlight %s: %zu edits, %zu comparisons, %zu lines\n", passed ? "ok" : "FAILED", options.ops, checks, buffer.text.lineCount);
+    highlight_cancel(buffer.highlight);
+    buffer_close_file(buffer);
+    unlink(journal_path(CHECK_PATH).c_str());
+
+    bool recovered = check_startup_recovery();
+    printf("startup recovery %s\n", recovered ? "ok" : "FAILED");
+    return passed && recovered ? EXIT_SUCCESS : EXIT_FAILURE;
+}
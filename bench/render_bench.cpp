@@ -0,0 +1,143 @@
+#include "../src/render/glyph_renderer.hpp"
+#include "../vendor/raylib/include/rlgl.h"
+#include "stats.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Draw submission cost of one full 1280x720 screen of text, per-character DrawText
+// against the batched glyph renderer.
+//
+//   build/render_bench [--frames N]
+//
+// Frames are drawn into an offscreen render texture so vsync never enters the timing;
+// each sample ends with the rlgl batch flushed to the driver.
+
+const int RENDER_BENCH_WIDTH  = 1280;
+const int RENDER_BENCH_HEIGHT = 720;
+// Never saved; it only gives the edits a journal away from the editor's own scratch buffer.
+const char* const RENDER_BENCH_PATH = "/tmp/dc-render-bench.txt";
+
+GlyphAtlas render_bench_atlas;
+
+float render_bench_advance(int, char c) {
+    return render_bench_atlas.advances[(unsigned char)c];
+}
+
+typedef void (*RenderPath)(const Buffer& buffer, size_t line, float y, Vector<PlacedGlyph>& glyphs);
+
+// What buffer_draw did before the glyph renderer: one DrawText per character.
+void render_draw_text(const Buffer& buffer, size_t line, float y, Vector<PlacedGlyph>& glyphs) {
+    buffer_layout_line(buffer, line, glyphs);
+    for (const PlacedGlyph& placed : glyphs) {
+        char glyph[2] = { placed.c, '\0' };
+        DrawText(glyph, (int)(buffer.leftMargin + placed.x), (int)y, buffer.fontSize, RAYWHITE);
+    }
+}
+
+void render_glyph_batch(const Buffer& buffer, size_t line, float y, Vector<PlacedGlyph>& glyphs) {
+    buffer_layout_line(buffer, line, glyphs);
+    glyph_draw_placed(render_bench_atlas, glyphs, buffer.leftMargin, y, RAYWHITE);
+}
+
+// Straight from the piece table, without building a layout first.
+void render_glyph_run(const Buffer& buffer, size_t line, float y, Vector<PlacedGlyph>&) {
+    size_t lineStart = text_line_start(buffer.text, line);
+    size_t lineEnd   = std::min(text_line_end(buffer.text, line), lineStart + buffer_visible_columns(buffer));
+    float  x         = buffer.leftMargin;
+    text_for_each_chunk(buffer.text, lineStart, lineEnd, [&](const char* data, size_t length) {
+        x = glyph_draw_text(render_bench_atlas, data, length, x, y, buffer.spacing, RAYWHITE);
+    });
+}
+
+size_t render_bench_glyphs(const Buffer& buffer) {
+    Vector<PlacedGlyph> glyphs;
+    size_t count = 0;
+    for (size_t line = 0; line < std::min(buffer.text.lineCount, buffer_visible_lines(buffer)); line++) {
+        buffer_layout_line(buffer, line, glyphs);
+        for (const PlacedGlyph& placed : glyphs) count += placed.c != ' ';
+    }
+    return count;
+}
+
+void render_bench_path(Samples& samples, const Buffer& buffer, RenderTexture2D& target, size_t frames, RenderPath path) {
+    Vector<PlacedGlyph> glyphs;
+    size_t lines = std::min(buffer.text.lineCount, buffer_visible_lines(buffer));
+    for (size_t frame = 0; frame < frames; frame++) {
+        BeginTextureMode(target);
+            ClearBackground(GetColor(0x181818FF));
+            rlDrawRenderBatchActive();
+
+            Clock::time_point start = Clock::now();
+            for (size_t line = 0; line < lines; line++) {
+                path(buffer, line, 10 + line * buffer.fontSize, glyphs);
+            }
+            rlDrawRenderBatchActive();
+            samples.nanos.push_back(bench_elapsed(start));
+        EndTextureMode();
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t frames = 500;
+    for (int idx = 1; idx + 1 < argc; idx += 2) {
+        if (strcmp(argv[idx], "--frames") == 0) {
+            frames = std::max<size_t>(1, strtoull(argv[idx + 1], nullptr, 10));
+        } else {
+            fprintf(stderr, "usage: %s [--frames N]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // raylib does not survive a failed GLFW initialization, so check for a display first.
+    if (getenv("DISPLAY") == nullptr && getenv("WAYLAND_DISPLAY") == nullptr) {
+        fprintf(stderr, "render bench needs a display for its GL context\n");
+        return EXIT_FAILURE;
+    }
+
+    SetConfigFlags(FLAG_WINDOW_HIDDEN);
+    SetTraceLogLevel(LOG_WARNING);
+    InitWindow(RENDER_BENCH_WIDTH, RENDER_BENCH_HEIGHT, "dc-editor render bench");
+    if (!IsWindowReady()) {
+        fprintf(stderr, "render bench needs a display for its GL context\n");
+        return EXIT_FAILURE;
+    }
+    RenderTexture2D target = LoadRenderTexture(RENDER_BENCH_WIDTH, RENDER_BENCH_HEIGHT);
+
+    Buffer buffer;
+    buffer_initialize(buffer);
+    buffer.name = RENDER_BENCH_PATH;
+    glyph_atlas_build(render_bench_atlas, GetFontDefault(), (int)buffer.fontSize);
+    buffer.measureGlyph = &render_bench_advance;
+    buffer_set_viewport(buffer, RENDER_BENCH_WIDTH, RENDER_BENCH_HEIGHT);
+
+    // Dense code-like text, wider than the screen so every row is full.
+    String text;
+    for (size_t line = 0; line < buffer_visible_lines(buffer); line++) {
+        for (size_t column = 0; column < 240; column++) {
+            text.push_back((char)('!' + (line * 7 + column * 13) % 94));
+        }
+        text.push_back('\n');
+    }
+    buffer_insert_text(buffer, text.data(), text.size());
+    buffer.cursor = {0, 0};
+
+    printf("%zu glyphs per frame, %zu frames\n", render_bench_glyphs(buffer), frames);
+    printf("%-12s %-10s %8s %10s %10s %10s %10s  %15s\n", "screen", "renderer", "frames", "p50 us", "p90 us", "p99 us", "max us", "throughput");
+
+    Samples drawText = { "DrawText", {}, 0 };
+    Samples batch    = { "batched",  {}, 0 };
+    Samples run      = { "run",      {}, 0 };
+    render_bench_path(drawText, buffer, target, frames, &render_draw_text);
+    render_bench_path(batch,    buffer, target, frames, &render_glyph_batch);
+    render_bench_path(run,      buffer, target, frames, &render_glyph_run);
+    bench_report("1280x720", drawText);
+    bench_report("1280x720", batch);
+    bench_report("1280x720", run);
+
+    buffer_close_file(buffer);
+    UnloadRenderTexture(target);
+    CloseWindow();
+    return EXIT_SUCCESS;
+}
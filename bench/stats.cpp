@@ -0,0 +1,35 @@
+#include "stats.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+double bench_elapsed(Clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+double bench_percentile(const Vector<double>& sorted, double p) {
+    return sorted[(size_t)(p * (sorted.size() - 1))];
+}
+
+// One line per operation: latency percentiles in microseconds and throughput, either
+// in operations or (when `bytes` is set) in megabytes per second.
+void bench_report(const String& document, Samples& samples) {
+    if (samples.nanos.empty()) return;
+
+    Vector<double>& sorted = samples.nanos;
+    std::sort(sorted.begin(), sorted.end());
+    double total = 0;
+    for (double nanos : sorted) total += nanos;
+
+    char throughput[64];
+    if (samples.bytes > 0) {
+        snprintf(throughput, sizeof(throughput), "%10.1f MB/s", samples.bytes / (total / 1e9) / (1 << 20));
+    } else {
+        snprintf(throughput, sizeof(throughput), "%10.0f op/s", sorted.size() / (total / 1e9));
+    }
+
+    printf("%-12s %-10s %8zu %10.2f %10.2f %10.2f %10.2f  %s\n", document.c_str(), samples.name.c_str(), sorted.size(),
+           bench_percentile(sorted, 0.50) / 1e3, bench_percentile(sorted, 0.90) / 1e3,
+           bench_percentile(sorted, 0.99) / 1e3, sorted.back() / 1e3, throughput);
+}
+
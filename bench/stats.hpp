@@ -0,0 +1,17 @@
+#pragma once
+
+#include "../src/core/types.hpp"
+
+#include <chrono>
+
+typedef std::chrono::steady_clock Clock;
+
+struct Samples {
+    String               name;
+    Vector<double>       nanos;
+    size_t               bytes;
+};
+
+double bench_elapsed(Clock::time_point start);
+double bench_percentile(const Vector<double>& sorted, double p);
+void   bench_report(const String& document, Samples& samples);
@@ -0,0 +1,973 @@
+#include "buffer.hpp"
+
+#include <cstdint>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Stand-in used until a frontend supplies real glyph metrics.
+float glyph_measure_monospace(int fontSize, char) {
+    return fontSize / 2;
+}
+
+void buffer_initialize(Buffer& buffer) {
+    buffer.leftMargin = 10;
+    buffer.cursor     = {0, 0};
+    buffer.scroll     = {0, 0};
+    buffer.mode       = Mode::NORMAL;
+    buffer.spacing    = 7;
+    buffer.fontSize   = 20;
+    buffer.measureGlyph   = &glyph_measure_monospace;
+    buffer.viewportWidth  = 1280;
+    buffer.viewportHeight = 720;
+    buffer.name       = "./first_file.txt";
+    buffer.file       = { nullptr, 0, 0 };
+    buffer.disk       = { 0, 0 };
+    buffer.history.budget = UNDO_DEFAULT_BUDGET;
+    text_initialize(buffer.text);
+    history_initialize(buffer.history);
+    highlight_initialize(buffer.highlight);
+    buffer.search.version     = 0;
+    buffer.search.origin      = 0;
+    buffer.search.jumpPending = false;
+    buffer.savedVersion       = buffer.text.version;
+    buffer.lastActive         = 0;
+    buffer.evicted            = false;
+    buffer.evictedOffset      = 0;
+    buffer.evictedIndexed     = 0;
+    buffer.evictedNewlines.clear();
+    buffer.lineClock          = 0;
+    buffer.lineVersions.clear();
+    buffer.lineRanges.clear();
+    buffer_clear_line_widths(buffer);
+}
+
+float buffer_measure_char(const Buffer& buffer, char c) {
+    return buffer.measureGlyph(buffer.fontSize, c) + buffer.spacing;
+}
+
+void buffer_clear_line_widths(const Buffer& buffer) {
+    buffer.lineWidths.clear();
+    buffer.lineWidthEntries = 0;
+}
+
+// Drops other lines, in no particular order, until `grow` more floats and one more line fit.
+void buffer_trim_line_widths(const Buffer& buffer, size_t keep, size_t grow) {
+    HashMap<size_t, Vector<float>>::iterator it = buffer.lineWidths.begin();
+    while (it != buffer.lineWidths.end()
+           && (buffer.lineWidthEntries + grow > LINE_WIDTH_CACHE_ENTRIES || buffer.lineWidths.size() >= LINE_WIDTH_CACHE_LINES)) {
+        if (it->first == keep) {
+            ++it;
+            continue;
+        }
+        buffer.lineWidthEntries -= it->second.capacity();
+        it = buffer.lineWidths.erase(it);
+    }
+}
+
+// prefix[i] is the width of the first i glyphs of `line`, so cursor placement is a lookup
+// and hit testing a binary search. A prefix is measured only as far as it has been asked
+// for, at least up to `column` (or the end of the line), and an edit only cuts it back to
+// the edited column. The cache is bounded by the floats it holds as well as by lines.
+const Vector<float>& buffer_line_widths(const Buffer& buffer, size_t line, size_t column) {
+    HashMap<size_t, Vector<float>>::iterator found = buffer.lineWidths.find(line);
+    if (found != buffer.lineWidths.end() && found->second.size() > column) return found->second;
+
+    size_t lineStart = text_line_start(buffer.text, line);
+    size_t lineEnd   = text_line_end(buffer.text, line);
+    size_t end       = std::min(lineEnd, lineStart + column);
+    if (found != buffer.lineWidths.end() && lineStart + found->second.size() - 1 >= end) return found->second;
+
+    size_t capacity = found != buffer.lineWidths.end() ? found->second.capacity() : 0;
+    size_t needed   = end - lineStart + 1;
+    size_t reserved = capacity >= needed ? capacity : std::max(needed, capacity + capacity / 2);
+    buffer_trim_line_widths(buffer, line, reserved - capacity);
+
+    Vector<float>& prefix = buffer.lineWidths[line];
+    prefix.reserve(reserved);
+    if (prefix.empty()) prefix.push_back(0);
+
+    // Long runs go through a table of every byte's width rather than a call per glyph.
+    size_t from = lineStart + prefix.size() - 1;
+    if (end - from >= LINE_WIDTH_TABLE_RUN) {
+        float advance[256];
+        for (int c = 0; c < 256; c++) advance[c] = buffer_measure_char(buffer, (char)c);
+        text_for_each_chunk(buffer.text, from, end, [&](const char* data, size_t length) {
+            float x = prefix.back();
+            for (size_t idx = 0; idx < length; idx++) {
+                x += advance[(unsigned char)data[idx]];
+                prefix.push_back(x);
+            }
+        });
+    } else {
+        text_for_each_chunk(buffer.text, from, end, [&](const char* data, size_t length) {
+            for (size_t idx = 0; idx < length; idx++) {
+                prefix.push_back(prefix.back() + buffer_measure_char(buffer, data[idx]));
+            }
+        });
+    }
+    buffer.lineWidthEntries += prefix.capacity() - capacity;
+    return prefix;
+}
+
+// The text of `line` changed from `column` on; the widths before it still hold.
+void buffer_invalidate_line(Buffer& buffer, size_t line, size_t column) {
+    HashMap<size_t, Vector<float>>::iterator found = buffer.lineWidths.find(line);
+    if (found != buffer.lineWidths.end() && found->second.size() > column + 1) {
+        found->second.resize(column + 1);
+    }
+    if (buffer.lineVersions.size() >= LINE_VERSION_STAMPS) {
+        return buffer_invalidate_lines_from(buffer, 0);
+    }
+    buffer.lineVersions[line] = ++buffer.lineClock;
+}
+
+// Used when lines are inserted or removed: every line from `line` on is renumbered.
+// Ranges are kept sorted by `from` and, since a new range drops every range starting at
+// or after it, by version too; past LINE_VERSION_RANGES the two oldest are merged, which
+// only ever makes lines look newer than they are.
+void buffer_invalidate_lines_from(Buffer& buffer, size_t line) {
+    for (HashMap<size_t, Vector<float>>::iterator it = buffer.lineWidths.begin(); it != buffer.lineWidths.end();) {
+        if (it->first < line) {
+            ++it;
+            continue;
+        }
+        buffer.lineWidthEntries -= it->second.capacity();
+        it = buffer.lineWidths.erase(it);
+    }
+    for (HashMap<size_t, size_t>::iterator it = buffer.lineVersions.begin(); it != buffer.lineVersions.end();) {
+        it = it->first >= line ? buffer.lineVersions.erase(it) : std::next(it);
+    }
+
+    Vector<LineRange>& ranges = buffer.lineRanges;
+    while (!ranges.empty() && ranges.back().from >= line) ranges.pop_back();
+    if (ranges.size() >= LINE_VERSION_RANGES) {
+        ranges[1].from = ranges[0].from;
+        ranges.erase(ranges.begin());
+    }
+
+    LineRange range;
+    range.from    = line;
+    range.version = ++buffer.lineClock;
+    ranges.push_back(range);
+}
+
+// Changes whenever the text of `line` may have changed, so anything derived from one
+// line (its widths, a rendered image of it) can be cached under this key.
+size_t buffer_line_version(const Buffer& buffer, size_t line) {
+    size_t version = 0;
+    HashMap<size_t, size_t>::const_iterator stamp = buffer.lineVersions.find(line);
+    if (stamp != buffer.lineVersions.end()) version = stamp->second;
+
+    size_t lo = 0;
+    size_t hi = buffer.lineRanges.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (buffer.lineRanges[mid].from <= line) lo = mid + 1; else hi = mid;
+    }
+    return lo > 0 ? std::max(version, buffer.lineRanges[lo - 1].version) : version;
+}
+
+// Column whose left edge is closest to `x`, measured from the start of `line`.
+size_t buffer_column_at(const Buffer& buffer, size_t line, float x) {
+    size_t measure = 256;
+    const Vector<float>* widths = &buffer_line_widths(buffer, line, measure);
+    while (widths->back() <= x && widths->size() > measure) {
+        measure *= 2;
+        widths = &buffer_line_widths(buffer, line, measure);
+    }
+
+    const Vector<float>& prefix = *widths;
+    size_t column = std::upper_bound(prefix.begin(), prefix.end(), x) - prefix.begin();
+    if (column == 0) return 0;
+
+    column--;
+    if (column + 1 < prefix.size() && x - prefix[column] > prefix[column + 1] - x) {
+        column++;
+    }
+    return column;
+}
+
+bool buffer_is_insert_mode(const Buffer& buffer) {
+    return buffer.mode == Mode::INSERT;
+}
+
+bool buffer_is_normal_mode(const Buffer& buffer) {
+    return buffer.mode == Mode::NORMAL;
+}
+
+bool buffer_is_command_mode(const Buffer& buffer) {
+    return buffer.mode == Mode::COMMAND;
+}
+
+bool buffer_is_search_mode(const Buffer& buffer) {
+    return buffer.mode == Mode::SEARCH;
+}
+
+void buffer_enable_insert_mode(Buffer& buffer) {
+    if (buffer_is_normal_mode(buffer)) {
+        buffer.mode = Mode::INSERT;
+    }
+}
+
+void buffer_enable_normal_mode(Buffer& buffer) {
+    buffer.mode           = Mode::NORMAL;
+    buffer.history.sealed = true;
+}
+
+void buffer_enable_select_mode(Buffer& buffer) {
+    if (buffer_is_normal_mode(buffer)) {
+        buffer.mode = Mode::SELECT;
+    }
+}
+
+void buffer_enable_command_mode(Buffer& buffer) {
+    if (buffer_is_normal_mode(buffer)) {
+        buffer.mode = Mode::COMMAND;
+    }
+}
+
+void buffer_enable_search_mode(Buffer& buffer) {
+    if (buffer_is_normal_mode(buffer)) {
+        buffer.mode = Mode::SEARCH;
+    }
+}
+
+size_t buffer_line_length(const Buffer& buffer, size_t line) {
+    return text_line_length(buffer.text, line);
+}
+
+size_t buffer_cursor_offset(const Buffer& buffer) {
+    return text_line_start(buffer.text, buffer.cursor.y) + buffer.cursor.x;
+}
+
+void buffer_cursor_move_left(Buffer& buffer) {
+    if (buffer.cursor.x > 0) {
+        buffer.cursor.x--;
+    } else if (buffer.cursor.y > 0) {
+        buffer.cursor.y--;
+        buffer.cursor.x = buffer_line_length(buffer, buffer.cursor.y);
+    }
+}
+
+void buffer_cursor_move_right(Buffer& buffer) {
+    if (buffer.cursor.x < buffer_line_length(buffer, buffer.cursor.y)) {
+        buffer.cursor.x++;
+    } else if (buffer.cursor.y < buffer.text.lineCount - 1) {
+        buffer.cursor.y++;
+        buffer.cursor.x = 0;
+    }
+}
+
+void buffer_cursor_move_up(Buffer& buffer) {
+    if (buffer.cursor.y > 0) {
+        buffer.cursor.y--;
+        buffer.cursor.x = std::min(buffer.cursor.x, buffer_line_length(buffer, buffer.cursor.y));
+    }
+}
+
+void buffer_cursor_move_down(Buffer& buffer) {
+    if (buffer.cursor.y < buffer.text.lineCount - 1) {
+        buffer.cursor.y++;
+        buffer.cursor.x = std::min(buffer.cursor.x, buffer_line_length(buffer, buffer.cursor.y));
+    }
+}
+
+// Places the cursor on the glyph under (x, y), given in viewport coordinates.
+void buffer_cursor_move_to_point(Buffer& buffer, float x, float y) {
+    float   row   = std::max(0.0f, (y - buffer.leftMargin) / buffer.fontSize);
+    size_t  line  = std::min(buffer.scroll.y + (size_t)row, buffer.text.lineCount - 1);
+
+    const Vector<float>& prefix = buffer_line_widths(buffer, line, buffer.scroll.x);
+    float scrollX = prefix[std::min(buffer.scroll.x, prefix.size() - 1)];
+
+    buffer.cursor.y = line;
+    buffer.cursor.x = buffer_column_at(buffer, line, x - buffer.leftMargin + scrollX);
+}
+
+// Journal of the unsaved edits, started by the first edit after a load or save.
+Journal& buffer_journal(Buffer& buffer) {
+    if (!buffer.journal) {
+        buffer.journal.reset(new Journal());
+        journal_start(*buffer.journal, journal_path(buffer.name), buffer.disk, 0);
+        if (buffer_is_saving(buffer)) journal_capture(*buffer.journal, true);
+    }
+    return *buffer.journal;
+}
+
+// Inserts at `offset` and records it in the undo history. The inserted bytes are the
+// tail of the add buffer, which is exactly the piece the history needs to keep.
+void buffer_insert_at(Buffer& buffer, size_t offset, const char* data, size_t length, const Position& cursorBefore) {
+    Piece piece;
+    piece.source   = PieceSource::ADD;
+    piece.start    = buffer.text.add->size();
+    piece.length   = length;
+    piece.newlines = 0;
+    text_insert(buffer.text, offset, data, length);
+    journal_insert(buffer_journal(buffer), offset, data, length);
+    history_record_insert(buffer.history, offset, piece, cursorBefore, buffer.cursor);
+}
+
+void buffer_insert_char(Buffer& buffer, char c) {
+    if (buffer_is_recovering(buffer)) return;
+    Position cursorBefore = buffer.cursor;
+    size_t  offset       = buffer_cursor_offset(buffer);
+    buffer_invalidate_line(buffer, buffer.cursor.y, buffer.cursor.x);
+    highlight_note_edit(buffer.highlight, buffer.cursor.y, 0, 0);
+    buffer.cursor.x++;
+    buffer_insert_at(buffer, offset, &c, 1, cursorBefore);
+}
+
+void buffer_add_new_line(Buffer& buffer) {
+    if (buffer_is_recovering(buffer)) return;
+    char    newline      = '\n';
+    Position cursorBefore = buffer.cursor;
+    size_t  offset       = text_line_end(buffer.text, buffer.cursor.y);
+    buffer_invalidate_lines_from(buffer, buffer.cursor.y + 1);
+    highlight_note_edit(buffer.highlight, buffer.cursor.y, 0, 1);
+    buffer.cursor.y++;
+    buffer.cursor.x = 0;
+    buffer_insert_at(buffer, offset, &newline, 1, cursorBefore);
+}
+
+void buffer_delete_char(Buffer& buffer) {
+    if (buffer_is_recovering(buffer)) return;
+    if (buffer.cursor.x > 0) {
+        Position       cursorBefore = buffer.cursor;
+        size_t        offset       = buffer_cursor_offset(buffer) - 1;
+        Vector<Piece> removed;
+        text_remove(buffer.text, offset, 1, removed);
+        journal_erase(buffer_journal(buffer), offset, 1);
+        buffer_invalidate_line(buffer, buffer.cursor.y, buffer.cursor.x - 1);
+        highlight_note_edit(buffer.highlight, buffer.cursor.y, 0, 0);
+        buffer.cursor.x--;
+        history_record_erase(buffer.history, offset, 1, removed, cursorBefore, buffer.cursor);
+    }
+}
+
+// Inserts a whole block at the cursor as a single piece: the add buffer grows once and
+// the newline index is filled in one memchr pass, whatever the size of the block.
+void buffer_insert_text(Buffer& buffer, const char* data, size_t length) {
+    if (length == 0 || buffer_is_recovering(buffer)) return;
+
+    Position cursorBefore = buffer.cursor;
+    size_t  offset       = buffer_cursor_offset(buffer);
+    size_t  newlines     = std::count(data, data + length, '\n');
+    highlight_note_edit(buffer.highlight, buffer.cursor.y, 0, newlines);
+
+    if (newlines == 0) {
+        buffer_invalidate_line(buffer, buffer.cursor.y, buffer.cursor.x);
+        buffer.cursor.x += length;
+    } else {
+        const char* lastLine = data + length;
+        while (lastLine > data && lastLine[-1] != '\n') lastLine--;
+
+        buffer_invalidate_lines_from(buffer, buffer.cursor.y);
+        buffer.cursor.y += newlines;
+        buffer.cursor.x  = data + length - lastLine;
+    }
+
+    buffer.history.sealed = true;
+    buffer_insert_at(buffer, offset, data, length, cursorBefore);
+    buffer.history.sealed = true;
+}
+
+void buffer_restore_edit(Buffer& buffer, const Edit& edit, bool undo) {
+    bool   removing = (edit.kind == EditKind::INSERT) == undo;
+    size_t line     = text_line_of(buffer.text, edit.offset);
+    if (removing) {
+        size_t removedLines = text_line_of(buffer.text, edit.offset + edit.length) - line;
+        text_erase(buffer.text, edit.offset, edit.length);
+        journal_erase(buffer_journal(buffer), edit.offset, edit.length);
+        highlight_note_edit(buffer.highlight, line, removedLines, 0);
+    } else {
+        text_insert_pieces(buffer.text, edit.offset, edit.pieces);
+        size_t journaled = edit.offset;
+        text_for_each_chunk(buffer.text, edit.offset, edit.offset + edit.length, [&](const char* data, size_t length) {
+            journal_insert(buffer_journal(buffer), journaled, data, length);
+            journaled += length;
+        });
+        highlight_note_edit(buffer.highlight, line, 0, text_line_of(buffer.text, edit.offset + edit.length) - line);
+    }
+
+    buffer_invalidate_lines_from(buffer, line);
+    buffer.cursor         = undo ? edit.cursorBefore : edit.cursorAfter;
+    buffer.history.sealed = true;
+}
+
+// Undo and redo only touch the pieces of the edit itself, never the rest of the document.
+void buffer_undo(Buffer& buffer) {
+    if (buffer_is_recovering(buffer)) return;
+    UndoHistory& history = buffer.history;
+    if (history.undo.empty()) return;
+
+    buffer_restore_edit(buffer, history.undo.back(), true);
+    history.redo.push_back(std::move(history.undo.back()));
+    history.undo.pop_back();
+}
+
+void buffer_redo(Buffer& buffer) {
+    if (buffer_is_recovering(buffer)) return;
+    UndoHistory& history = buffer.history;
+    if (history.redo.empty()) return;
+
+    buffer_restore_edit(buffer, history.redo.back(), false);
+    history.undo.push_back(std::move(history.redo.back()));
+    history.redo.pop_back();
+}
+
+void buffer_move_cursor_to_offset(Buffer& buffer, size_t offset) {
+    buffer.cursor.y = text_line_of(buffer.text, offset);
+    buffer.cursor.x = offset - text_line_start(buffer.text, buffer.cursor.y);
+}
+
+bool buffer_search_is_current(const Buffer& buffer) {
+    return !buffer.search.pattern.empty() && !buffer.search.job && buffer.search.version == buffer.text.version;
+}
+
+void buffer_search_cancel(Buffer& buffer) {
+    if (buffer.search.job) {
+        buffer.search.job->cancelled = true;
+        buffer.search.job->worker.join();
+        buffer.search.job.reset();
+    }
+}
+
+// Moves to the first match at or after `offset` (wrapping around), or before it when
+// searching backwards.
+void buffer_search_jump(Buffer& buffer, size_t offset, bool forward, bool inclusive) {
+    const Vector<size_t>& matches = buffer.search.matches;
+    if (matches.empty()) return;
+
+    Vector<size_t>::const_iterator it;
+    if (forward) {
+        it = inclusive ? std::lower_bound(matches.begin(), matches.end(), offset)
+                       : std::upper_bound(matches.begin(), matches.end(), offset);
+        if (it == matches.end()) it = matches.begin();
+    } else {
+        it = std::lower_bound(matches.begin(), matches.end(), offset);
+        it = it == matches.begin() ? matches.end() - 1 : it - 1;
+    }
+    buffer_move_cursor_to_offset(buffer, *it);
+}
+
+void buffer_search_publish(Buffer& buffer, Vector<size_t>& matches, size_t version) {
+    buffer.search.matches.swap(matches);
+    buffer.search.version = version;
+    if (buffer.search.jumpPending) {
+        buffer.search.jumpPending = false;
+        buffer_search_jump(buffer, buffer.search.origin, true, true);
+    }
+}
+
+// Small documents are searched right away; larger ones on a SearchJob so typing the
+// pattern never waits for the scan. A newer pattern or edit cancels the running job.
+void buffer_search_run(Buffer& buffer) {
+    buffer_search_cancel(buffer);
+    buffer.search.matches.clear();
+    if (buffer.search.pattern.empty()) return;
+
+    const TextEngine& text = buffer.text;
+    if (text.size < SEARCH_SYNC_LIMIT) {
+        std::atomic<bool> cancelled(false);
+        Vector<size_t>    matches;
+        search_pieces(text.pieces, text.original, text.add->data(), buffer.search.pattern, cancelled, matches);
+        buffer_search_publish(buffer, matches, text.version);
+        return;
+    }
+
+    buffer.search.job.reset(new SearchJob());
+    SearchJob& job = *buffer.search.job;
+    job.cancelled = false;
+    job.finished  = false;
+    job.pattern   = buffer.search.pattern;
+    job.version   = text.version;
+    text_snapshot(text, job.snapshot);
+    job.worker    = std::thread(&search_job_run, &job);
+}
+
+void buffer_poll_search(Buffer& buffer) {
+    Search& search = buffer.search;
+    if (search.job && search.job->finished) {
+        search.job->worker.join();
+        buffer_search_publish(buffer, search.job->matches, search.job->version);
+        search.job.reset();
+    }
+
+    if (!search.pattern.empty() && !search.job && search.version != buffer.text.version) {
+        buffer_search_run(buffer);
+    }
+}
+
+// The text of an evicted buffer is gone until it is restored, so there is nothing to lex.
+void buffer_poll_highlight(Buffer& buffer) {
+    if (buffer.evicted) return;
+    highlight_poll(buffer.highlight, buffer.text);
+}
+
+void buffer_search_clear(Buffer& buffer) {
+    buffer_search_cancel(buffer);
+    buffer.search.pattern.clear();
+    buffer.search.matches.clear();
+    buffer.search.jumpPending = false;
+}
+
+void buffer_search_next(Buffer& buffer) {
+    buffer_search_jump(buffer, buffer_cursor_offset(buffer), true, false);
+}
+
+void buffer_search_previous(Buffer& buffer) {
+    buffer_search_jump(buffer, buffer_cursor_offset(buffer), false, false);
+}
+
+// Lines that fit between the top margin and the mini buffer bar.
+size_t buffer_visible_lines(const Buffer& buffer) {
+    int height = (int)buffer.viewportHeight - buffer.leftMargin - (int)buffer.fontSize;
+    return std::max(1, (int)(height / buffer.fontSize));
+}
+
+// Upper bound of the columns that fit on screen: every glyph advances at least `spacing`.
+size_t buffer_visible_columns(const Buffer& buffer) {
+    return (size_t)buffer.viewportWidth / std::max(1, buffer.spacing) + 1;
+}
+
+float buffer_visible_width(const Buffer& buffer) {
+    return buffer.viewportWidth - 2 * buffer.leftMargin;
+}
+
+void buffer_set_viewport(Buffer& buffer, float width, float height) {
+    buffer.viewportWidth  = width;
+    buffer.viewportHeight = height;
+}
+
+// Scrolls just enough to keep the cursor inside the viewport.
+void buffer_follow_cursor(Buffer& buffer) {
+    size_t visibleLines = buffer_visible_lines(buffer);
+    if (buffer.cursor.y < buffer.scroll.y) {
+        buffer.scroll.y = buffer.cursor.y;
+    } else if (buffer.cursor.y >= buffer.scroll.y + visibleLines) {
+        buffer.scroll.y = buffer.cursor.y - visibleLines + 1;
+    }
+
+    if (buffer.cursor.x < buffer.scroll.x) {
+        buffer.scroll.x = buffer.cursor.x;
+        return;
+    }
+
+    const Vector<float>& prefix = buffer_line_widths(buffer, buffer.cursor.y, buffer.cursor.x);
+    size_t column  = std::min(buffer.cursor.x, prefix.size() - 1);
+    float  cursorX = prefix[column];
+    if (cursorX - prefix[std::min(buffer.scroll.x, column)] > buffer_visible_width(buffer)) {
+        buffer.scroll.x = std::lower_bound(prefix.begin(), prefix.begin() + column, cursorX - buffer_visible_width(buffer)) - prefix.begin();
+    }
+}
+
+// Distance of the cursor from the left margin, after horizontal scrolling.
+float buffer_cursor_x(const Buffer& buffer) {
+    const Vector<float>& prefix = buffer_line_widths(buffer, buffer.cursor.y, buffer.cursor.x);
+    size_t column   = std::min(buffer.cursor.x, prefix.size() - 1);
+    size_t scrolled = std::min(buffer.scroll.x, column);
+    return prefix[column] - prefix[scrolled];
+}
+
+// Positions of the glyphs of `line` that fall inside the viewport, as buffer_draw shows them.
+void buffer_layout_line(const Buffer& buffer, size_t line, Vector<PlacedGlyph>& glyphs) {
+    glyphs.clear();
+
+    size_t lineStart = text_line_start(buffer.text, line);
+    size_t lineEnd   = text_line_end(buffer.text, line);
+    size_t begin     = std::min(lineStart + buffer.scroll.x, lineEnd);
+    size_t end       = std::min(begin + buffer_visible_columns(buffer), lineEnd);
+    float  x         = 0;
+    float  maxX      = buffer.viewportWidth - buffer.leftMargin;
+
+    text_for_each_chunk(buffer.text, begin, end, [&](const char* data, size_t length) {
+        for (size_t idx = 0; idx < length && x < maxX; idx++) {
+            PlacedGlyph glyph;
+            glyph.c = data[idx];
+            glyph.x = x;
+            glyphs.push_back(glyph);
+            x += buffer_measure_char(buffer, data[idx]);
+        }
+    });
+}
+
+bool buffer_is_saving(const Buffer& buffer) {
+    return buffer.writer && buffer.writer->worker.joinable();
+}
+
+void buffer_wait_save(Buffer& buffer) {
+    if (buffer_is_saving(buffer)) {
+        buffer.writer->worker.join();
+    }
+}
+
+// Hands a snapshot of the buffer to a FileWriter; progress and errors are reported by
+// buffer_poll_save. The file is never truncated in place, which also keeps a mapping
+// of the file being overwritten valid.
+void save(Buffer& buffer) {
+    if (buffer_is_saving(buffer) || buffer_is_recovering(buffer)) return;
+
+    struct stat info;
+    buffer.writer.reset(new FileWriter());
+    buffer.writer->path     = buffer.name;
+    buffer.writer->mode     = stat(buffer.name.c_str(), &info) == 0 ? (info.st_mode & 07777) : 0644;
+    buffer.writer->written  = 0;
+    buffer.writer->total    = buffer.text.size + 1;
+    buffer.writer->version  = buffer.text.version;
+    buffer.writer->finished = false;
+    text_snapshot(buffer.text, buffer.writer->snapshot);
+    buffer.writer->worker   = std::thread(&file_writer_run, buffer.writer.get());
+    if (buffer.journal) journal_capture(*buffer.journal, true);
+}
+
+// The old journal described edits to the file as it was before the save. The edits made
+// while the save was running were captured as they were journaled; they refer to the
+// text that was saved, so they start the journal of the new file unchanged.
+void buffer_journal_rebase(Buffer& buffer) {
+    if (!buffer.journal) return;
+
+    String edits;
+    journal_take_captured(*buffer.journal, edits);
+    journal_stop(*buffer.journal, true);
+    buffer.journal.reset();
+    if (buffer_is_modified(buffer)) journal_append(buffer_journal(buffer), edits);
+}
+
+void buffer_poll_save(Buffer& buffer, String& message) {
+    if (!buffer.writer) return;
+
+    bool   finished;
+    String error;
+    {
+        std::lock_guard<std::mutex> lock(buffer.writer->mutex);
+        finished = buffer.writer->finished;
+        error    = buffer.writer->error;
+    }
+
+    const String& path = buffer.writer->path;
+    if (!finished) {
+        size_t percent = buffer.writer->written * 100 / buffer.writer->total;
+        message = "saving " + path + " " + std::to_string(percent) + "%";
+        return;
+    }
+
+    buffer_wait_save(buffer);
+    if (error.empty()) {
+        buffer.savedVersion = buffer.writer->version;
+        file_stamp(buffer.disk, path.c_str());
+        buffer_journal_rebase(buffer);
+        message = "\"" + path + "\" " + std::to_string(buffer.writer->total) + " bytes written";
+    } else {
+        message = "error saving " + path + ": " + error;
+        if (buffer.journal) journal_capture(*buffer.journal, false);
+    }
+    buffer.writer.reset();
+}
+
+void buffer_clamp_cursor(Buffer& buffer) {
+    buffer.cursor.y = std::min(buffer.cursor.y, buffer.text.lineCount - 1);
+    buffer.cursor.x = std::min(buffer.cursor.x, buffer_line_length(buffer, buffer.cursor.y));
+}
+
+void buffer_close_file(Buffer& buffer) {
+    buffer_wait_save(buffer);
+    if (buffer.recovery) {
+        buffer.recovery->worker.join();
+        buffer.recovery.reset();
+    }
+    buffer_search_clear(buffer);
+    if (buffer.indexer) {
+        buffer.indexer->cancelled = true;
+        buffer.indexer->worker.join();
+        buffer.indexer.reset();
+    }
+    highlight_cancel(buffer.highlight);
+    highlight_initialize(buffer.highlight);
+    if (buffer.journal) {
+        journal_stop(*buffer.journal, true);
+        buffer.journal.reset();
+    }
+    buffer.disk = { 0, 0 };
+    text_clear(buffer.text);
+    history_initialize(buffer.history);
+    buffer_invalidate_lines_from(buffer, 0);
+    file_unmap(buffer.file);
+}
+
+// Loads the mapped file as the whole document. `newlines` are those of its first
+// `indexed` bytes, as far as they are already known, and are taken over. Indexing
+// continues synchronously up to `upTo` (at least one screen); the rest of the newline
+// index is built by a LineIndexer and merged in by buffer_poll_line_index.
+void buffer_load_mapping(Buffer& buffer, size_t upTo, Vector<size_t>& newlines, size_t indexed) {
+    const FileMapping& file = buffer.file;
+    text_load_original(buffer.text, file.data, file.size);
+    buffer_invalidate_lines_from(buffer, 0);
+    highlight_invalidate(buffer.highlight);
+    buffer.savedVersion = buffer.text.version;
+
+    size_t scanned = std::min(file.size, std::max(upTo, LINE_INDEX_FIRST_SCREEN));
+    if (scanned > indexed) {
+        line_index_scan(file.data, indexed, scanned, newlines);
+        indexed = scanned;
+    }
+    buffer.text.originalNewlines.swap(newlines);
+    text_index_original(buffer.text, Vector<size_t>(), indexed);
+    newlines.clear();
+
+    if (indexed < file.size) {
+        buffer.indexer.reset(new LineIndexer());
+        buffer.indexer->cancelled = false;
+        buffer.indexer->indexed   = indexed;
+        buffer.indexer->finished  = false;
+        buffer.indexer->worker    = std::thread(&line_indexer_run, buffer.indexer.get(), file.data, indexed, file.size);
+    }
+}
+
+bool buffer_open_file(Buffer& buffer, const String& path) {
+    FileMapping file;
+    if (!file_map(file, path.c_str())) return false;
+
+    buffer_close_file(buffer);
+    buffer.file    = file;
+    buffer.name    = path;
+    buffer.cursor  = {0, 0};
+    buffer.scroll  = {0, 0};
+    buffer.evicted = false;
+    buffer.disk    = { file.size, file.mtime };
+    buffer.highlight.language = highlight_language_for(path);
+    Vector<size_t> newlines;
+    buffer_load_mapping(buffer, 0, newlines, 0);
+    return true;
+}
+
+void buffer_poll_line_index(Buffer& buffer) {
+    if (!buffer.indexer) return;
+
+    Vector<size_t> newlines;
+    size_t         indexed;
+    bool           finished;
+    {
+        std::lock_guard<std::mutex> lock(buffer.indexer->mutex);
+        newlines.swap(buffer.indexer->pending);
+        indexed  = buffer.indexer->indexed;
+        finished = buffer.indexer->finished;
+    }
+
+    if (indexed != buffer.text.originalIndexed) {
+        // Lines before the last one known so far keep their text and numbers; that one
+        // ran to the end of the unindexed text and is now split up.
+        size_t lastLine = buffer.text.lineCount - 1;
+        text_index_original(buffer.text, newlines, indexed);
+        buffer_invalidate_lines_from(buffer, lastLine);
+        buffer_clamp_cursor(buffer);
+    }
+
+    if (finished) {
+        buffer.indexer->worker.join();
+        buffer.indexer.reset();
+    }
+}
+
+// Moves a journal that does not fit the file out of the way, so it is neither replayed
+// nor overwritten.
+void buffer_set_aside_journal(const String& path, const String& error, String& message) {
+    String stale = path + ".stale";
+    rename(path.c_str(), stale.c_str());
+    message = "journal " + path + " not replayed (" + error + "), moved to " + stale;
+}
+
+// Recovered edits become unsaved changes with no undo history, and journaling continues
+// in the same file from its last intact record.
+void buffer_recovered(Buffer& buffer, const String& path, const JournalReplay& replay, String& message) {
+    history_initialize(buffer.history);
+    buffer_invalidate_lines_from(buffer, 0);
+    highlight_invalidate(buffer.highlight);
+    buffer_clamp_cursor(buffer);
+
+    buffer.journal.reset(new Journal());
+    journal_start(*buffer.journal, path, buffer.disk, replay.validSize);
+    message = "recovered " + std::to_string(replay.operations) + " edits to " + buffer.name + " from " + path;
+}
+
+// Replays the journal a previous session left behind for this buffer, if any. A small
+// journal is applied as piece table edits over the mapped file, which leaves the file
+// mapped and its newline index building. A larger one is replayed on a JournalRecovery
+// worker, and the buffer stays read-only until buffer_poll_recovery adopts the result.
+bool buffer_recover(Buffer& buffer, String& message) {
+    String path = journal_path(buffer.name);
+    struct stat info;
+    if (buffer.journal || buffer.recovery || stat(path.c_str(), &info) != 0) return false;
+
+    if ((size_t)info.st_size > JOURNAL_PIECE_REPLAY_SIZE) {
+        buffer.recovery.reset(new JournalRecovery());
+        JournalRecovery& recovery = *buffer.recovery;
+        recovery.finished = false;
+        recovery.path     = path;
+        recovery.base     = buffer.disk;
+        text_snapshot(buffer.text, recovery.snapshot);
+        recovery.worker   = std::thread(&journal_recovery_run, &recovery);
+        message = "recovering edits to " + buffer.name + " from " + path;
+        return true;
+    }
+
+    String                contents;
+    Vector<JournalRecord> records;
+    String                error;
+    if (!journal_read(path, buffer.disk, contents, records, error)) {
+        buffer_set_aside_journal(path, error, message);
+        return false;
+    }
+
+    JournalReplay replay;
+    replay.operations = 0;
+    replay.validSize  = JOURNAL_HEADER_SIZE;
+    for (const JournalRecord& record : records) {
+        if (!journal_record_fits(record, buffer.text.size)) break;
+
+        if (record.op == JournalOp::INSERT) {
+            text_insert(buffer.text, record.offset, record.data, record.length);
+        } else {
+            text_erase(buffer.text, record.offset, record.length);
+        }
+        replay.operations++;
+        replay.validSize = record.end;
+    }
+    buffer_recovered(buffer, path, replay, message);
+    return true;
+}
+
+bool buffer_is_recovering(const Buffer& buffer) {
+    return buffer.recovery != nullptr;
+}
+
+void buffer_poll_recovery(Buffer& buffer, String& message) {
+    if (!buffer.recovery || !buffer.recovery->finished) return;
+
+    JournalRecovery& recovery = *buffer.recovery;
+    recovery.worker.join();
+    if (recovery.replayed) {
+        if (buffer.indexer) {
+            buffer.indexer->cancelled = true;
+            buffer.indexer->worker.join();
+            buffer.indexer.reset();
+        }
+        size_t version = buffer.text.version;
+        buffer.text = std::move(recovery.text);
+        buffer.text.version = version + 1;
+        buffer_recovered(buffer, recovery.path, recovery.replay, message);
+    } else {
+        buffer_set_aside_journal(recovery.path, recovery.error, message);
+    }
+    buffer.recovery.reset();
+}
+
+// A journal that cannot be written is reported once; editing goes on without it.
+void buffer_poll_journal(Buffer& buffer, String& message) {
+    if (!buffer.journal) return;
+
+    std::lock_guard<std::mutex> lock(buffer.journal->mutex);
+    if (!buffer.journal->error.empty() && !buffer.journal->reported) {
+        buffer.journal->reported = true;
+        message = "journal " + buffer.journal->path + ": " + buffer.journal->error;
+    }
+}
+
+bool buffer_is_modified(const Buffer& buffer) {
+    return !buffer.evicted && buffer.text.version != buffer.savedVersion;
+}
+
+// Heap memory held by the buffer; the mapped file itself is left to the page cache.
+size_t buffer_memory_footprint(const Buffer& buffer) {
+    const TextEngine& text = buffer.text;
+    size_t bytes = text.add->capacity()
+                 + text.pieces.capacity() * sizeof(Piece)
+                 + (text.originalNewlines.capacity() + text.addNewlines.capacity()) * sizeof(size_t)
+                 + (text.pieceOffsets.capacity() + text.pieceLines.capacity()) * sizeof(size_t)
+                 + buffer.search.matches.capacity() * sizeof(size_t)
+                 + buffer.evictedNewlines.capacity() * sizeof(size_t)
+                 + buffer.history.bytes
+                 + highlight_memory_footprint(buffer.highlight);
+    for (HashMap<size_t, Vector<float>>::const_iterator it = buffer.lineWidths.begin(); it != buffer.lineWidths.end(); ++it) {
+        bytes += it->second.capacity() * sizeof(float);
+    }
+    return bytes;
+}
+
+// Drops what an inactive buffer can rebuild cheaply when it becomes active again.
+void buffer_compact(Buffer& buffer) {
+    buffer_search_cancel(buffer);
+    Vector<size_t>().swap(buffer.search.matches);
+    buffer.search.version = SIZE_MAX;
+    buffer_clear_line_widths(buffer);
+}
+
+// After a save the mapping still holds the old file; the saved file on disk is what the
+// text matches, and only as long as nothing else has rewritten it since.
+bool buffer_mapping_is_current(const Buffer& buffer) {
+    return buffer.file.size == buffer.disk.size && buffer.file.mtime == buffer.disk.mtime;
+}
+
+// The undo history refers to the add buffer, which eviction releases, so a buffer that
+// can still be undone or redone stays loaded.
+bool buffer_can_evict(const Buffer& buffer) {
+    if (buffer.evicted || buffer.file.data == nullptr || buffer_is_modified(buffer) || buffer_is_saving(buffer) || buffer_is_recovering(buffer)) return false;
+    if (!buffer.history.undo.empty() || !buffer.history.redo.empty()) return false;
+    if (buffer_mapping_is_current(buffer)) return true;
+
+    FileStamp stamp;
+    return file_stamp(stamp, buffer.name.c_str()) && stamp.size == buffer.disk.size && stamp.mtime == buffer.disk.mtime;
+}
+
+// An unmodified buffer is exactly its mapped file, so everything but the mapping, its
+// newline index and the cursor position can be released. A mapping left over from before
+// a save is replaced by the saved file first, whose newlines are those of the text plus
+// the one save() ends it with; false if that file can no longer be mapped as it was saved.
+bool buffer_evict(Buffer& buffer) {
+    FileMapping saved = { nullptr, 0, 0 };
+    if (!buffer_mapping_is_current(buffer)) {
+        if (!file_map(saved, buffer.name.c_str())) return false;
+        if (saved.size != buffer.disk.size || saved.mtime != buffer.disk.mtime) {
+            file_unmap(saved);
+            return false;
+        }
+    }
+
+    if (buffer.indexer) {
+        buffer.indexer->cancelled = true;
+        buffer.indexer->worker.join();
+        buffer.indexer.reset();
+    }
+
+    buffer.evictedOffset = buffer_cursor_offset(buffer);
+    buffer.evictedNewlines.clear();
+    buffer.evictedIndexed = 0;
+    if (saved.data != nullptr) {
+        if (buffer.text.originalIndexed == buffer.text.originalSize) {
+            text_collect_newlines(buffer.text, buffer.evictedNewlines);
+            if (saved.size > buffer.text.size) buffer.evictedNewlines.push_back(buffer.text.size);
+            buffer.evictedIndexed = saved.size;
+        }
+        file_unmap(buffer.file);
+        buffer.file = saved;
+    } else {
+        buffer.evictedNewlines.swap(buffer.text.originalNewlines);
+        buffer.evictedIndexed = buffer.text.originalIndexed;
+    }
+    buffer_compact(buffer);
+    highlight_cancel(buffer.highlight);
+    buffer.highlight.result.reset();
+    text_clear(buffer.text);
+    history_initialize(buffer.history);
+    buffer.evicted = true;
+    return true;
+}
+
+void buffer_restore(Buffer& buffer) {
+    if (!buffer.evicted) return;
+
+    buffer.evicted = false;
+    buffer_load_mapping(buffer, buffer.evictedOffset + LINE_INDEX_FIRST_SCREEN, buffer.evictedNewlines, buffer.evictedIndexed);
+    Vector<size_t>().swap(buffer.evictedNewlines);
+    buffer.evictedIndexed = 0;
+    buffer_move_cursor_to_offset(buffer, std::min(buffer.evictedOffset, buffer.text.size));
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "file_io.hpp"
+#include "history.hpp"
+#include "search.hpp"
+#include "highlight.hpp"
+#include "journal.hpp"
+
+enum class Mode { NORMAL, INSERT, SELECT, COMMAND, SEARCH };
+
+// Horizontal advance of `c` at `fontSize`; supplied by whoever renders the text.
+typedef float (*GlyphMeasure)(int fontSize, char c);
+
+const size_t LINE_WIDTH_CACHE_LINES   = 512;
+const size_t LINE_WIDTH_CACHE_ENTRIES = 8 << 20;
+const size_t LINE_WIDTH_TABLE_RUN     = 4096;
+const size_t LINE_VERSION_STAMPS      = 4096;
+const size_t LINE_VERSION_RANGES      = 64;
+
+// Every line from `from` on was renumbered or rewritten at `version`.
+struct LineRange {
+    size_t               from;
+    size_t               version;
+};
+
+struct Buffer {
+    int                  leftMargin;
+    TextEngine           text;
+    Position             cursor;
+    Position             scroll;
+    Mode                 mode;
+    int                  spacing;
+    float                fontSize;
+    GlyphMeasure         measureGlyph;
+    // Size of the area the buffer is drawn into, kept up to date by the frontend.
+    float                viewportWidth;
+    float                viewportHeight;
+    String               name;
+    char                 lastCharPressed;
+    FileMapping          file;
+    // The file on disk the text was loaded from or last saved to; journals refer to it.
+    FileStamp            disk;
+    std::unique_ptr<Journal> journal;
+    std::unique_ptr<JournalRecovery> recovery;
+    std::unique_ptr<LineIndexer> indexer;
+    std::unique_ptr<FileWriter>  writer;
+    UndoHistory          history;
+    Search               search;
+    Highlight            highlight;
+    // Prefix widths of recently measured lines, see buffer_line_widths.
+    mutable HashMap<size_t, Vector<float>> lineWidths;
+    mutable size_t       lineWidthEntries;
+    // Content versions of lines, see buffer_line_version.
+    size_t               lineClock;
+    HashMap<size_t, size_t> lineVersions;
+    Vector<LineRange>    lineRanges;
+    size_t               savedVersion;
+    size_t               lastActive;
+    bool                 evicted;
+    size_t               evictedOffset;
+    // Newline index of the mapped file, kept while evicted; it covers `evictedIndexed` bytes.
+    Vector<size_t>       evictedNewlines;
+    size_t               evictedIndexed;
+};
+
+// Horizontal position of one glyph of a laid out line, relative to the left margin.
+struct PlacedGlyph {
+    char                 c;
+    float                x;
+};
+
+float  glyph_measure_monospace(int fontSize, char c);
+
+void   buffer_initialize(Buffer& buffer);
+float  buffer_measure_char(const Buffer& buffer, char c);
+void   buffer_clear_line_widths(const Buffer& buffer);
+const Vector<float>& buffer_line_widths(const Buffer& buffer, size_t line, size_t column);
+void   buffer_invalidate_line(Buffer& buffer, size_t line, size_t column);
+void   buffer_invalidate_lines_from(Buffer& buffer, size_t line);
+size_t buffer_line_version(const Buffer& buffer, size_t line);
+size_t buffer_column_at(const Buffer& buffer, size_t line, float x);
+
+bool   buffer_is_insert_mode(const Buffer& buffer);
+bool   buffer_is_normal_mode(const Buffer& buffer);
+bool   buffer_is_command_mode(const Buffer& buffer);
+bool   buffer_is_search_mode(const Buffer& buffer);
+void   buffer_enable_insert_mode(Buffer& buffer);
+void   buffer_enable_normal_mode(Buffer& buffer);
+void   buffer_enable_select_mode(Buffer& buffer);
+void   buffer_enable_command_mode(Buffer& buffer);
+void   buffer_enable_search_mode(Buffer& buffer);
+
+size_t buffer_line_length(const Buffer& buffer, size_t line);
+size_t buffer_cursor_offset(const Buffer& buffer);
+void   buffer_cursor_move_left(Buffer& buffer);
+void   buffer_cursor_move_right(Buffer& buffer);
+void   buffer_cursor_move_up(Buffer& buffer);
+void   buffer_cursor_move_down(Buffer& buffer);
+void   buffer_cursor_move_to_point(Buffer& buffer, float x, float y);
+void   buffer_move_cursor_to_offset(Buffer& buffer, size_t offset);
+
+void   buffer_insert_char(Buffer& buffer, char c);
+void   buffer_add_new_line(Buffer& buffer);
+void   buffer_delete_char(Buffer& buffer);
+void   buffer_insert_text(Buffer& buffer, const char* data, size_t length);
+void   buffer_undo(Buffer& buffer);
+void   buffer_redo(Buffer& buffer);
+
+bool   buffer_search_is_current(const Buffer& buffer);
+void   buffer_search_run(Buffer& buffer);
+void   buffer_poll_search(Buffer& buffer);
+void   buffer_poll_highlight(Buffer& buffer);
+void   buffer_search_clear(Buffer& buffer);
+void   buffer_search_next(Buffer& buffer);
+void   buffer_search_previous(Buffer& buffer);
+
+size_t buffer_visible_lines(const Buffer& buffer);
+size_t buffer_visible_columns(const Buffer& buffer);
+float  buffer_visible_width(const Buffer& buffer);
+void   buffer_set_viewport(Buffer& buffer, float width, float height);
+void   buffer_follow_cursor(Buffer& buffer);
+float  buffer_cursor_x(const Buffer& buffer);
+void   buffer_layout_line(const Buffer& buffer, size_t line, Vector<PlacedGlyph>& glyphs);
+
+bool   buffer_is_saving(const Buffer& buffer);
+void   buffer_wait_save(Buffer& buffer);
+void   save(Buffer& buffer);
+void   buffer_poll_save(Buffer& buffer, String& message);
+
+void   buffer_close_file(Buffer& buffer);
+bool   buffer_open_file(Buffer& buffer, const String& path);
+void   buffer_poll_line_index(Buffer& buffer);
+bool   buffer_recover(Buffer& buffer, String& message);
+bool   buffer_is_recovering(const Buffer& buffer);
+void   buffer_poll_recovery(Buffer& buffer, String& message);
+void   buffer_poll_journal(Buffer& buffer, String& message);
+
+bool   buffer_is_modified(const Buffer& buffer);
+size_t buffer_memory_footprint(const Buffer& buffer);
+void   buffer_compact(Buffer& buffer);
+bool   buffer_can_evict(const Buffer& buffer);
+bool   buffer_evict(Buffer& buffer);
+void   buffer_restore(Buffer& buffer);
@@ -0,0 +1,264 @@
+#include "editor.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <sys/stat.h>
+
+void editor_initialize_buffer(const Editor& editor, Buffer& buffer) {
+    buffer_initialize(buffer);
+    buffer.measureGlyph = editor.measureGlyph;
+}
+
+void editor_initialize(Editor& editor) {
+    editor.current      = 0;
+    editor.memoryBudget = EDITOR_DEFAULT_MEMORY_BUDGET;
+    editor.clock        = 0;
+    editor.measureGlyph = &glyph_measure_monospace;
+    editor.quit         = false;
+    profiler_initialize(editor.profiler, nullptr, 0);
+    explorer_initialize(editor.explorer);
+    editor.buffers.clear();
+    editor.buffers.push_back(std::unique_ptr<Buffer>(new Buffer()));
+    editor_initialize_buffer(editor, *editor.buffers.back());
+}
+
+// Glyph metrics come from the frontend; everything laid out with the old ones is invalidated.
+void editor_set_glyph_measure(Editor& editor, GlyphMeasure measureGlyph) {
+    editor.measureGlyph = measureGlyph;
+    for (const std::unique_ptr<Buffer>& buffer : editor.buffers) {
+        buffer->measureGlyph = measureGlyph;
+        buffer_invalidate_lines_from(*buffer, 0);
+    }
+}
+
+Buffer& editor_current(Editor& editor) {
+    return *editor.buffers[editor.current];
+}
+
+// Evicts the least recently used unmodified buffers until the open buffers fit the budget.
+void editor_enforce_memory_budget(Editor& editor) {
+    size_t total = 0;
+    for (const std::unique_ptr<Buffer>& buffer : editor.buffers) {
+        total += buffer_memory_footprint(*buffer);
+    }
+
+    while (total > editor.memoryBudget) {
+        Buffer* victim = nullptr;
+        for (size_t idx = 0; idx < editor.buffers.size(); idx++) {
+            Buffer& buffer = *editor.buffers[idx];
+            if (idx != editor.current && buffer_can_evict(buffer) && (victim == nullptr || buffer.lastActive < victim->lastActive)) {
+                victim = &buffer;
+            }
+        }
+        if (victim == nullptr) return;
+
+        total -= buffer_memory_footprint(*victim);
+        if (!buffer_evict(*victim)) return;
+        total += buffer_memory_footprint(*victim);
+    }
+}
+
+void editor_switch_to(Editor& editor, size_t idx) {
+    if (idx != editor.current) {
+        buffer_compact(editor_current(editor));
+        editor.current = idx;
+    }
+
+    Buffer& buffer = editor_current(editor);
+    buffer_restore(buffer);
+    buffer.lastActive = ++editor.clock;
+    editor_enforce_memory_budget(editor);
+}
+
+void editor_next_buffer(Editor& editor, String&) {
+    editor_switch_to(editor, (editor.current + 1) % editor.buffers.size());
+}
+
+void editor_previous_buffer(Editor& editor, String&) {
+    editor_switch_to(editor, (editor.current + editor.buffers.size() - 1) % editor.buffers.size());
+}
+
+void editor_list_buffers(Editor& editor, String& message) {
+    message.clear();
+    for (size_t idx = 0; idx < editor.buffers.size(); idx++) {
+        const Buffer& buffer = *editor.buffers[idx];
+        message += std::to_string(idx + 1);
+        message += idx == editor.current ? "%" : " ";
+        message += buffer_is_modified(buffer) ? "+ " : "  ";
+        message += buffer.name;
+        message += buffer.evicted ? " (evicted)   " : "   ";
+    }
+}
+
+// Resolves "." and "..", symbolic links and relative paths, so every spelling of a file
+// names the same buffer (and the same journal). A file not written yet, like the startup
+// buffer's, is resolved through its directory; `path` itself if that fails too.
+String editor_canonical_path(const String& path) {
+    char* resolved = realpath(path.c_str(), nullptr);
+    if (resolved != nullptr) {
+        String canonical = resolved;
+        free(resolved);
+        return canonical;
+    }
+
+    size_t slash     = path.rfind('/');
+    String directory = slash == String::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    String name      = slash == String::npos ? path : path.substr(slash + 1);
+    resolved = realpath(directory.c_str(), nullptr);
+    if (resolved == nullptr || name.empty() || name == "." || name == "..") {
+        free(resolved);
+        return path;
+    }
+
+    String canonical = resolved;
+    free(resolved);
+    return canonical == "/" ? canonical + name : canonical + "/" + name;
+}
+
+// Switches to the buffer already showing `path`, reuses an untouched scratch buffer, or
+// opens the file in a new buffer. Names are compared canonically on both sides: the
+// startup buffer keeps the name it was given until a file is opened into it.
+void editor_open_file(Editor& editor, String& message, const String& requested) {
+    String path = editor_canonical_path(requested);
+    for (size_t idx = 0; idx < editor.buffers.size(); idx++) {
+        if (editor_canonical_path(editor.buffers[idx]->name) == path) {
+            return editor_switch_to(editor, idx);
+        }
+    }
+
+    Buffer& current = editor_current(editor);
+    bool reuse = current.file.data == nullptr && current.text.size == 0 && !buffer_is_modified(current) && !buffer_is_saving(current);
+
+    std::unique_ptr<Buffer> buffer(reuse ? nullptr : new Buffer());
+    Buffer& target = reuse ? current : *buffer;
+    if (!reuse) editor_initialize_buffer(editor, target);
+
+    if (!buffer_open_file(target, path)) {
+        message = "error opening " + path + ": " + strerror(errno);
+        return;
+    }
+    buffer_recover(target, message);
+
+    if (!reuse) {
+        editor.buffers.push_back(std::move(buffer));
+        editor_switch_to(editor, editor.buffers.size() - 1);
+    }
+}
+
+// The startup buffer loads its file when an earlier session saved it, so the disk stamp
+// its journal was written against is there to be matched before edits are replayed.
+void editor_open_startup_buffer(Editor& editor, String& message) {
+    Buffer& buffer = editor_current(editor);
+    String  path   = editor_canonical_path(buffer.name);
+    struct stat info;
+    if (stat(path.c_str(), &info) == 0 && !buffer_open_file(buffer, path)) {
+        message = "error opening " + path + ": " + strerror(errno);
+        return;
+    }
+    buffer_recover(buffer, message);
+}
+
+void editor_close(Editor& editor) {
+    for (const std::unique_ptr<Buffer>& buffer : editor.buffers) {
+        buffer_close_file(*buffer);
+    }
+    explorer_close(editor.explorer);
+}
+
+void editor_quit(Editor& editor, String&) {
+    editor.quit = true;
+}
+
+void editor_toggle_profile(Editor& editor, String& message) {
+    editor.profiler.overlay = !editor.profiler.overlay;
+    message = editor.profiler.overlay ? "profiler overlay on" : "profiler overlay off";
+}
+
+// ":profile dump [path]" writes the recorded frames as a Chrome trace.
+void editor_profile(Editor& editor, String& message, const String& argument) {
+    if (argument != "dump" && argument.compare(0, 5, "dump ") != 0) {
+        message = "unknown profile command: " + argument;
+        return;
+    }
+
+    String path = argument.size() > 5 ? argument.substr(5) : EDITOR_TRACE_PATH;
+    String error;
+    if (profiler_write_trace(editor.profiler, path, error)) {
+        message = "\"" + path + "\" " + std::to_string(editor.profiler.frames.size()) + " frames written";
+    } else {
+        message = "error writing " + path + ": " + error;
+    }
+}
+
+// ":explore" opens the working directory the first time, then cycles the pane through
+// focused, hidden and back.
+void editor_toggle_explorer(Editor& editor, String& message) {
+    Explorer& explorer = editor.explorer;
+    if (!explorer.scan) {
+        editor_explore(editor, message, ".");
+    } else if (!explorer.visible || !explorer.focused) {
+        explorer.visible = true;
+        explorer.focused = true;
+    } else {
+        explorer.visible = false;
+        explorer.focused = false;
+    }
+}
+
+void editor_explore(Editor& editor, String& message, const String& directory) {
+    struct stat info;
+    if (stat(directory.c_str(), &info) != 0 || !S_ISDIR(info.st_mode)) {
+        message = "not a directory: " + directory;
+        return;
+    }
+    explorer_open(editor.explorer, directory);
+}
+
+// Background work of every buffer is collected, not only the visible one.
+void editor_poll(Editor& editor, String& message) {
+    for (const std::unique_ptr<Buffer>& buffer : editor.buffers) {
+        buffer_poll_line_index(*buffer);
+        buffer_poll_save(*buffer, message);
+        buffer_poll_highlight(*buffer);
+        buffer_poll_recovery(*buffer, message);
+        buffer_poll_journal(*buffer, message);
+    }
+    explorer_poll(editor.explorer);
+}
+
+typedef void (BufferCommandHandler)(Buffer& buffer);
+
+void editor_dispatch_command(Buffer& buffer, bool condition, BufferCommandHandler handler) {
+    if (condition) handler(buffer);
+}
+
+typedef void (EditorCommandHandler)(Editor& editor, String& message);
+
+void editor_dispatch_command(Editor& editor, String& message, bool condition, EditorCommandHandler handler) {
+    if (condition) handler(editor, message);
+}
+
+typedef void (EditorCommandHandlerWithArgument)(Editor& editor, String& message, const String& argument);
+
+void editor_dispatch_command(Editor& editor, String& message, const String& content, const String& command, EditorCommandHandlerWithArgument handler) {
+    if (content.size() > command.size() + 1 && content.compare(0, command.size(), command) == 0 && content[command.size()] == ' ') {
+        handler(editor, message, content.substr(command.size() + 1));
+    }
+}
+
+// Runs one ":" command line against the current buffer; the outcome is left in `message`.
+void editor_execute_command(Editor& editor, const String& command, String& message) {
+    Buffer& buffer = editor_current(editor);
+    message.clear();
+    editor_dispatch_command(buffer, command == "w", &save);
+    editor_dispatch_command(editor, message, command == "q",  &editor_quit);
+    editor_dispatch_command(editor, message, command == "bn", &editor_next_buffer);
+    editor_dispatch_command(editor, message, command == "bp", &editor_previous_buffer);
+    editor_dispatch_command(editor, message, command == "ls", &editor_list_buffers);
+    editor_dispatch_command(editor, message, command == "profile", &editor_toggle_profile);
+    editor_dispatch_command(editor, message, command == "explore", &editor_toggle_explorer);
+    editor_dispatch_command(editor, message, command, "e", &editor_open_file);
+    editor_dispatch_command(editor, message, command, "profile", &editor_profile);
+    editor_dispatch_command(editor, message, command, "explore", &editor_explore);
+}
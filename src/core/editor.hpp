@@ -0,0 +1,37 @@
+#pragma once
+
+#include "buffer.hpp"
+#include "profiler.hpp"
+#include "explorer.hpp"
+
+const size_t EDITOR_DEFAULT_MEMORY_BUDGET = 512 << 20;
+const char* const EDITOR_TRACE_PATH = "./dc-editor-trace.json";
+
+struct Editor {
+    Vector<std::unique_ptr<Buffer>> buffers;
+    size_t               current;
+    size_t               memoryBudget;
+    size_t               clock;
+    GlyphMeasure         measureGlyph;
+    bool                 quit;
+    Profiler             profiler;
+    Explorer             explorer;
+};
+
+void    editor_initialize(Editor& editor);
+void    editor_set_glyph_measure(Editor& editor, GlyphMeasure measureGlyph);
+Buffer& editor_current(Editor& editor);
+void    editor_switch_to(Editor& editor, size_t idx);
+void    editor_next_buffer(Editor& editor, String& message);
+void    editor_previous_buffer(Editor& editor, String& message);
+void    editor_list_buffers(Editor& editor, String& message);
+void    editor_open_file(Editor& editor, String& message, const String& path);
+void    editor_open_startup_buffer(Editor& editor, String& message);
+void    editor_close(Editor& editor);
+void    editor_quit(Editor& editor, String& message);
+void    editor_toggle_profile(Editor& editor, String& message);
+void    editor_profile(Editor& editor, String& message, const String& argument);
+void    editor_toggle_explorer(Editor& editor, String& message);
+void    editor_explore(Editor& editor, String& message, const String& directory);
+void    editor_poll(Editor& editor, String& message);
+void    editor_execute_command(Editor& editor, const String& command, String& message);
@@ -0,0 +1,510 @@
+#include "explorer.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <dirent.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+typedef std::chrono::steady_clock ExplorerClock;
+
+const uint32_t EXPLORER_WATCH_EVENTS = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+char explorer_lower(char c) {
+    return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+// Letters (either case) and digits get a bit each, everything else shares the rest, so a
+// path can only match a query whose mask is a subset of its own.
+uint64_t explorer_char_mask(const char* data, size_t length) {
+    uint64_t mask = 0;
+    for (size_t idx = 0; idx < length; idx++) {
+        unsigned char c = explorer_lower(data[idx]);
+        if (c >= 'a' && c <= 'z')      mask |= (uint64_t)1 << (c - 'a');
+        else if (c >= '0' && c <= '9') mask |= (uint64_t)1 << (26 + c - '0');
+        else                           mask |= (uint64_t)1 << (36 + c % 28);
+    }
+    return mask;
+}
+
+bool explorer_is_separator(char c) {
+    return c == '/' || c == '_' || c == '-' || c == '.' || c == ' ';
+}
+
+// Matches the lowercase `query` as a subsequence of `path`, aligned as far right as it
+// goes so matches land in the file name when they can. Starts of words, runs of
+// consecutive characters and the file name score higher; -1 means no match.
+int explorer_fuzzy_score(const char* path, size_t length, size_t name, const char* query, size_t queryLength) {
+    size_t remaining = queryLength;
+    size_t previous  = SIZE_MAX;
+    int    score     = 0;
+    for (size_t idx = length; idx-- > 0 && remaining > 0;) {
+        if (explorer_lower(path[idx]) != query[remaining - 1]) continue;
+
+        remaining--;
+        score += 1;
+        if (idx == 0 || explorer_is_separator(path[idx - 1]))                                         score += 8;
+        else if (path[idx] >= 'A' && path[idx] <= 'Z' && path[idx - 1] >= 'a' && path[idx - 1] <= 'z') score += 6;
+        if (idx >= name)          score += 2;
+        if (previous == idx + 1)  score += 6;
+        previous = idx;
+    }
+    if (remaining > 0) return -1;
+    return score * 64 - (int)std::min(length, (size_t)63);
+}
+
+String explorer_path_join(const String& directory, const String& name) {
+    return directory.empty() ? name : directory + "/" + name;
+}
+
+bool explorer_is_ignored(const char* name) {
+    for (const char* const* ignored = EXPLORER_IGNORED; *ignored != nullptr; ignored++) {
+        if (strcmp(name, *ignored) == 0) return true;
+    }
+    return false;
+}
+
+// Reads `directory` (relative to `root`); false when it is gone or unreadable.
+bool explorer_list(const String& root, const String& directory, DirectoryListing& listing) {
+    String path = directory.empty() ? root : root + "/" + directory;
+    DIR* dir = opendir(path.c_str());
+    if (dir == nullptr) return false;
+
+    while (dirent* entry = readdir(dir)) {
+        const char* name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+
+        bool isDirectory = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat info;
+            String child = path + "/" + name;
+            isDirectory = lstat(child.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+        }
+        if (isDirectory && explorer_is_ignored(name)) continue;
+        (isDirectory ? listing.directories : listing.files).push_back(name);
+    }
+    closedir(dir);
+
+    std::sort(listing.directories.begin(), listing.directories.end());
+    std::sort(listing.files.begin(), listing.files.end());
+    return true;
+}
+
+void explorer_queue(ExplorerScan& scan, const String& directory) {
+    bool& queued = scan.queued[directory];
+    if (queued) return;
+    queued = true;
+    scan.queue.push_back(directory);
+}
+
+// Drops `directory` and everything cached below it, watches included.
+void explorer_forget(ExplorerScan& scan, const String& directory) {
+    HashMap<String, DirectoryListing>::iterator found = scan.cache.find(directory);
+    if (found == scan.cache.end()) return;
+
+    DirectoryListing listing;
+    listing.directories.swap(found->second.directories);
+    if (found->second.watch >= 0) {
+        // inotify hands out one watch per inode: a directory moved elsewhere in the tree may
+        // already have been listed under its new path, which then owns the watch.
+        HashMap<int, String>::iterator watched = scan.watches.find(found->second.watch);
+        if (watched != scan.watches.end() && watched->second == directory) {
+            inotify_rm_watch(scan.inotify, found->second.watch);
+            scan.watches.erase(watched);
+        }
+    } else {
+        scan.unwatched--;
+    }
+    scan.cache.erase(found);
+    for (const String& child : listing.directories) {
+        explorer_forget(scan, explorer_path_join(directory, child));
+    }
+}
+
+// Replaces the cached listing of `directory` with a fresh one read from disk.
+void explorer_merge(ExplorerScan& scan, const String& directory, bool exists, DirectoryListing& listing) {
+    HashMap<String, DirectoryListing>::iterator old = scan.cache.find(directory);
+    if (!exists) {
+        // An unreadable root still publishes its (empty) snapshot, so the scan completes.
+        scan.changed = scan.changed || old != scan.cache.end() || directory.empty();
+        explorer_forget(scan, directory);
+        return;
+    }
+
+    if (old != scan.cache.end()) {
+        const DirectoryListing& previous = old->second;
+        if (previous.directories == listing.directories && previous.files == listing.files) return;
+
+        Vector<String> removed;
+        std::set_difference(previous.directories.begin(), previous.directories.end(),
+                            listing.directories.begin(), listing.directories.end(), std::back_inserter(removed));
+        listing.watch = previous.watch;
+        for (const String& child : removed) {
+            explorer_forget(scan, explorer_path_join(directory, child));
+        }
+    } else {
+        String path   = directory.empty() ? scan.root : scan.root + "/" + directory;
+        listing.watch = scan.inotify >= 0 ? inotify_add_watch(scan.inotify, path.c_str(), EXPLORER_WATCH_EVENTS) : -1;
+        if (listing.watch >= 0) scan.watches[listing.watch] = directory; else scan.unwatched++;
+    }
+
+    for (const String& child : listing.directories) {
+        String path = explorer_path_join(directory, child);
+        if (scan.cache.find(path) == scan.cache.end()) explorer_queue(scan, path);
+    }
+    scan.cache[directory] = std::move(listing);
+    scan.changed = true;
+}
+
+size_t explorer_push_node(ExplorerSnapshot& snapshot, const String& path, size_t name, uint16_t depth, bool directory) {
+    ExplorerNode node;
+    node.path      = snapshot.paths.size();
+    node.length    = path.size();
+    node.name      = name;
+    node.end       = snapshot.nodes.size() + 1;
+    node.depth     = depth;
+    node.directory = directory;
+    snapshot.paths.append(path);
+    snapshot.paths.push_back('\0');
+    snapshot.nodes.push_back(node);
+    snapshot.masks.push_back(explorer_char_mask(path.data(), path.size()));
+    return snapshot.nodes.size() - 1;
+}
+
+void explorer_build(const ExplorerScan& scan, String& path, uint16_t depth, ExplorerSnapshot& snapshot) {
+    HashMap<String, DirectoryListing>::const_iterator found = scan.cache.find(path);
+    if (found == scan.cache.end()) return;
+
+    const DirectoryListing& listing = found->second;
+    size_t base = path.size();
+    size_t name = base > 0 ? base + 1 : 0;
+    for (const String& child : listing.directories) {
+        if (base > 0) path.push_back('/');
+        path.append(child);
+        size_t idx = explorer_push_node(snapshot, path, name, depth, true);
+        explorer_build(scan, path, depth + 1, snapshot);
+        snapshot.nodes[idx].end = snapshot.nodes.size();
+        path.resize(base);
+    }
+    for (const String& child : listing.files) {
+        if (base > 0) path.push_back('/');
+        path.append(child);
+        explorer_push_node(snapshot, path, name, depth, false);
+        snapshot.files++;
+        path.resize(base);
+    }
+}
+
+// Called with `scan.mutex` held.
+void explorer_publish(ExplorerScan& scan) {
+    std::shared_ptr<ExplorerSnapshot> snapshot(new ExplorerSnapshot());
+    snapshot->files     = 0;
+    snapshot->unwatched = scan.unwatched;
+    snapshot->version   = ++scan.version;
+    snapshot->complete = scan.queue.empty() && scan.busy == 0;
+    String path;
+    explorer_build(scan, path, 0, *snapshot);
+
+    scan.changed     = false;
+    scan.lastPublish = ExplorerClock::now();
+    std::lock_guard<std::mutex> lock(scan.publishMutex);
+    scan.published = snapshot;
+}
+
+void explorer_scanner_run(ExplorerScan* scan) {
+    std::unique_lock<std::mutex> lock(scan->mutex);
+    for (;;) {
+        scan->wake.wait(lock, [&] { return scan->stopping || !scan->queue.empty(); });
+        if (scan->stopping) return;
+
+        String directory = std::move(scan->queue.back());
+        scan->queue.pop_back();
+        scan->queued.erase(directory);
+        scan->busy++;
+        lock.unlock();
+
+        DirectoryListing listing;
+        bool exists = explorer_list(scan->root, directory, listing);
+
+        lock.lock();
+        scan->busy--;
+        explorer_merge(*scan, directory, exists, listing);
+        scan->wake.notify_all();
+
+        bool drained = scan->queue.empty() && scan->busy == 0;
+        bool due     = ExplorerClock::now() - scan->lastPublish >= std::chrono::milliseconds(EXPLORER_PUBLISH_INTERVAL);
+        if (scan->changed && (drained || due)) explorer_publish(*scan);
+    }
+}
+
+// Every change inotify reports is turned into a rescan of the directory it happened in;
+// a queue overflow means events were lost, so everything cached is rescanned.
+void explorer_watcher_run(ExplorerScan* scan) {
+    alignas(inotify_event) char events[16 << 10];
+    pollfd fds[2] = { { scan->inotify, POLLIN, 0 }, { scan->stopEvent, POLLIN, 0 } };
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        if (fds[1].revents != 0) return;
+
+        ssize_t count = read(scan->inotify, events, sizeof(events));
+        if (count <= 0) continue;
+
+        std::lock_guard<std::mutex> lock(scan->mutex);
+        for (char* at = events; at < events + count;) {
+            const inotify_event* event = (const inotify_event*)at;
+            at += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                for (HashMap<String, DirectoryListing>::const_iterator it = scan->cache.begin(); it != scan->cache.end(); ++it) {
+                    explorer_queue(*scan, it->first);
+                }
+                continue;
+            }
+            HashMap<int, String>::const_iterator watched = scan->watches.find(event->wd);
+            if (watched != scan->watches.end() && !(event->mask & IN_IGNORED)) {
+                explorer_queue(*scan, watched->second);
+            }
+        }
+        scan->wake.notify_all();
+    }
+}
+
+void explorer_scan_start(ExplorerScan& scan, const String& root) {
+    scan.root        = root;
+    scan.inotify     = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    scan.stopEvent   = eventfd(0, EFD_CLOEXEC);
+    scan.busy        = 0;
+    scan.unwatched   = 0;
+    scan.version     = 0;
+    scan.stopping    = false;
+    scan.changed     = false;
+    scan.lastPublish = ExplorerClock::now();
+    explorer_queue(scan, "");
+
+    for (size_t idx = 0; idx < EXPLORER_SCANNERS; idx++) {
+        scan.scanners.push_back(std::thread(&explorer_scanner_run, &scan));
+    }
+    if (scan.inotify >= 0 && scan.stopEvent >= 0) {
+        scan.watcher = std::thread(&explorer_watcher_run, &scan);
+    }
+}
+
+void explorer_scan_stop(ExplorerScan& scan) {
+    {
+        std::lock_guard<std::mutex> lock(scan.mutex);
+        scan.stopping = true;
+    }
+    scan.wake.notify_all();
+    if (scan.stopEvent >= 0) {
+        uint64_t one = 1;
+        if (write(scan.stopEvent, &one, sizeof(one)) < 0) {}
+    }
+
+    for (std::thread& scanner : scan.scanners) {
+        scanner.join();
+    }
+    if (scan.watcher.joinable()) scan.watcher.join();
+    if (scan.inotify >= 0) close(scan.inotify);
+    if (scan.stopEvent >= 0) close(scan.stopEvent);
+    scan.scanners.clear();
+}
+
+typedef std::pair<int, uint32_t> ExplorerMatch;
+
+// Higher scores first, then tree order.
+bool explorer_match_better(const ExplorerMatch& a, const ExplorerMatch& b) {
+    return a.first != b.first ? a.first > b.first : a.second < b.second;
+}
+
+// Keeps the best EXPLORER_FILTER_RESULTS files in a heap whose front is the worst of
+// them, so most candidates cost a mask test and a comparison.
+void explorer_filter_run(ExplorerFilterJob* job) {
+    const ExplorerSnapshot& snapshot = *job->snapshot;
+    String query = job->query;
+    std::transform(query.begin(), query.end(), query.begin(), &explorer_lower);
+    uint64_t need = explorer_char_mask(query.data(), query.size());
+
+    Vector<ExplorerMatch> best;
+    best.reserve(EXPLORER_FILTER_RESULTS + 1);
+    for (size_t idx = 0; idx < snapshot.nodes.size(); idx++) {
+        if (idx % EXPLORER_FILTER_CHECK == 0 && job->cancelled) break;
+
+        const ExplorerNode& node = snapshot.nodes[idx];
+        if (node.directory || (snapshot.masks[idx] & need) != need) continue;
+
+        int score = explorer_fuzzy_score(snapshot.paths.data() + node.path, node.length, node.name, query.data(), query.size());
+        if (score < 0) continue;
+
+        ExplorerMatch match(score, idx);
+        if (best.size() == EXPLORER_FILTER_RESULTS) {
+            if (!explorer_match_better(match, best.front())) continue;
+            std::pop_heap(best.begin(), best.end(), &explorer_match_better);
+            best.pop_back();
+        }
+        best.push_back(match);
+        std::push_heap(best.begin(), best.end(), &explorer_match_better);
+    }
+
+    std::sort_heap(best.begin(), best.end(), &explorer_match_better);
+    for (const ExplorerMatch& match : best) {
+        job->matches.push_back(match.second);
+    }
+    job->finished = true;
+}
+
+void explorer_initialize(Explorer& explorer) {
+    explorer.scan.reset();
+    explorer.snapshot.reset();
+    explorer.expanded.clear();
+    explorer.rows.clear();
+    explorer.query.clear();
+    explorer.filtered.clear();
+    explorer.filteredSnapshot.reset();
+    explorer.matches.clear();
+    explorer.filter.reset();
+    explorer.selected = 0;
+    explorer.scroll   = 0;
+    explorer.visible  = false;
+    explorer.focused  = false;
+}
+
+void explorer_open(Explorer& explorer, const String& root) {
+    explorer_close(explorer);
+    explorer.scan.reset(new ExplorerScan());
+    explorer_scan_start(*explorer.scan, root);
+    explorer.visible = true;
+    explorer.focused = true;
+}
+
+void explorer_close(Explorer& explorer) {
+    if (explorer.filter) {
+        explorer.filter->cancelled = true;
+        explorer.filter->worker.join();
+    }
+    if (explorer.scan) {
+        explorer_scan_stop(*explorer.scan);
+    }
+    explorer_initialize(explorer);
+}
+
+// Visible tree rows: every node, minus the subtrees of collapsed directories.
+void explorer_rebuild_rows(Explorer& explorer) {
+    explorer.rows.clear();
+    if (!explorer.snapshot) return;
+
+    const ExplorerSnapshot& snapshot = *explorer.snapshot;
+    for (size_t idx = 0; idx < snapshot.nodes.size();) {
+        const ExplorerNode& node = snapshot.nodes[idx];
+        explorer.rows.push_back(idx);
+        bool expanded = node.directory && explorer.expanded.count(explorer_node_path(snapshot, node)) > 0;
+        idx = node.directory && !expanded ? node.end : idx + 1;
+    }
+}
+
+void explorer_start_filter(Explorer& explorer) {
+    explorer.filter.reset(new ExplorerFilterJob());
+    ExplorerFilterJob& job = *explorer.filter;
+    job.cancelled = false;
+    job.finished  = false;
+    job.snapshot  = explorer.snapshot;
+    job.query     = explorer.query;
+    job.worker    = std::thread(&explorer_filter_run, &job);
+}
+
+void explorer_poll(Explorer& explorer) {
+    if (!explorer.scan) return;
+
+    std::shared_ptr<const ExplorerSnapshot> published;
+    {
+        std::lock_guard<std::mutex> lock(explorer.scan->publishMutex);
+        published = explorer.scan->published;
+    }
+    if (published != explorer.snapshot) {
+        explorer.snapshot = published;
+        explorer_rebuild_rows(explorer);
+    }
+
+    if (explorer.filter && explorer.filter->finished) {
+        explorer.filter->worker.join();
+        if (!explorer.filter->cancelled) {
+            explorer.matches.swap(explorer.filter->matches);
+            explorer.filtered         = explorer.filter->query;
+            explorer.filteredSnapshot = explorer.filter->snapshot;
+        }
+        explorer.filter.reset();
+    }
+    if (!explorer.filter && explorer.snapshot && !explorer.query.empty()
+        && (explorer.filtered != explorer.query || explorer.filteredSnapshot != explorer.snapshot)) {
+        explorer_start_filter(explorer);
+    }
+    explorer_select(explorer, 0);
+}
+
+bool explorer_is_scanning(const Explorer& explorer) {
+    return explorer.scan && (!explorer.snapshot || !explorer.snapshot->complete);
+}
+
+// A running filter for an older query is cancelled; explorer_poll starts the next one
+// once it has stopped.
+void explorer_set_query(Explorer& explorer, const String& query) {
+    explorer.query = query;
+    if (explorer.filter && explorer.filter->query != query) {
+        explorer.filter->cancelled = true;
+    }
+    if (query.empty()) {
+        explorer.matches.clear();
+        explorer.filtered.clear();
+        explorer.filteredSnapshot.reset();
+    }
+    explorer.selected = 0;
+    explorer.scroll   = 0;
+}
+
+// While a query is active the rows are the last matches, shown against the snapshot they
+// were ranked in until a filter of the newer one replaces them.
+const ExplorerSnapshot* explorer_row_snapshot(const Explorer& explorer) {
+    return explorer.query.empty() ? explorer.snapshot.get() : explorer.filteredSnapshot.get();
+}
+
+size_t explorer_row_count(const Explorer& explorer) {
+    if (explorer_row_snapshot(explorer) == nullptr) return 0;
+    return explorer.query.empty() ? explorer.rows.size() : explorer.matches.size();
+}
+
+const ExplorerNode* explorer_row(const Explorer& explorer, size_t row) {
+    if (row >= explorer_row_count(explorer)) return nullptr;
+    const Vector<uint32_t>& rows = explorer.query.empty() ? explorer.rows : explorer.matches;
+    return &explorer_row_snapshot(explorer)->nodes[rows[row]];
+}
+
+const char* explorer_node_path(const ExplorerSnapshot& snapshot, const ExplorerNode& node) {
+    return snapshot.paths.data() + node.path;
+}
+
+void explorer_select(Explorer& explorer, long long delta) {
+    size_t count = explorer_row_count(explorer);
+    long long selected = (long long)explorer.selected + delta;
+    explorer.selected = count == 0 ? 0 : (size_t)std::max(0LL, std::min(selected, (long long)count - 1));
+}
+
+// Expands or collapses the selected directory, or returns the path of the selected file.
+bool explorer_activate(Explorer& explorer, String& path) {
+    const ExplorerNode* node = explorer_row(explorer, explorer.selected);
+    if (node == nullptr) return false;
+
+    const char* relative = explorer_node_path(*explorer_row_snapshot(explorer), *node);
+    if (node->directory) {
+        if (!explorer.expanded.erase(relative)) explorer.expanded[relative] = true;
+        explorer_rebuild_rows(explorer);
+        return false;
+    }
+    path = explorer.scan->root + "/" + relative;
+    return true;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "types.hpp"
+
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <condition_variable>
+
+const size_t   EXPLORER_SCANNERS         = 4;
+const uint64_t EXPLORER_PUBLISH_INTERVAL = 100;  // milliseconds
+const size_t   EXPLORER_FILTER_RESULTS   = 256;
+const size_t   EXPLORER_FILTER_CHECK     = 16384;
+const char* const EXPLORER_IGNORED[]     = { ".git", nullptr };
+
+// One directory as last read from disk, names sorted. Symbolic links are listed as
+// files, so the scan never follows a link cycle.
+struct DirectoryListing {
+    Vector<String>       directories;
+    Vector<String>       files;
+    int                  watch;
+};
+
+// Nodes are in depth-first order with directories first, so the subtree of a directory
+// is the nodes in [index + 1, end). `path` is the offset of the NUL-terminated path,
+// relative to the root, in ExplorerSnapshot::paths; `name` the offset of its last
+// component within it.
+struct ExplorerNode {
+    uint32_t             path;
+    uint32_t             length;
+    uint32_t             name;
+    uint32_t             end;
+    uint16_t             depth;
+    bool                 directory;
+};
+
+// The whole tree at one point of the scan. Never changed once published, so the render
+// thread and filter jobs share it without locks. `masks[i]` has a bit for every
+// character class in the path of node i (see explorer_char_mask). `unwatched` counts the
+// directories inotify refused, whose changes the tree will not pick up.
+struct ExplorerSnapshot {
+    String               paths;
+    Vector<ExplorerNode> nodes;
+    Vector<uint64_t>     masks;
+    size_t               files;
+    size_t               unwatched;
+    size_t               version;
+    bool                 complete;
+};
+
+// Scanner pool and inotify watcher of one root. Scanners take directories off `queue`,
+// list them into `cache` and queue the subdirectories they have not seen; the watcher
+// queues a directory again whenever inotify reports an entry added or removed in it.
+// A scanner publishes a new snapshot when the queue drains, and every
+// EXPLORER_PUBLISH_INTERVAL while a long scan is still running. Snapshots are built
+// under `mutex`; `published` has its own lock so the render thread never waits for one.
+struct ExplorerScan {
+    String               root;
+    Vector<std::thread>  scanners;
+    std::thread          watcher;
+    std::mutex           mutex;
+    std::condition_variable wake;
+    Vector<String>       queue;
+    HashMap<String, bool> queued;
+    HashMap<String, DirectoryListing> cache;
+    HashMap<int, String> watches;
+    int                  inotify;
+    int                  stopEvent;
+    size_t               busy;
+    size_t               unwatched;
+    size_t               version;
+    bool                 stopping;
+    bool                 changed;
+    std::chrono::steady_clock::time_point lastPublish;
+    std::mutex           publishMutex;
+    std::shared_ptr<const ExplorerSnapshot> published;
+};
+
+// Ranks the files of a snapshot against `query` on a worker thread, like SearchJob.
+struct ExplorerFilterJob {
+    std::thread          worker;
+    std::atomic<bool>    cancelled;
+    std::atomic<bool>    finished;
+    std::shared_ptr<const ExplorerSnapshot> snapshot;
+    String               query;
+    Vector<uint32_t>     matches;
+};
+
+// Render thread side of the explorer pane. It only ever reads `snapshot`, the last one
+// the scan published, and `matches`, the last finished filter; neither waits on disk.
+// `matches` index into `filteredSnapshot`, which may be older than `snapshot` until the
+// next filter finishes.
+struct Explorer {
+    std::unique_ptr<ExplorerScan> scan;
+    std::shared_ptr<const ExplorerSnapshot> snapshot;
+    HashMap<String, bool> expanded;
+    Vector<uint32_t>     rows;
+    String               query;
+    String               filtered;
+    std::shared_ptr<const ExplorerSnapshot> filteredSnapshot;
+    Vector<uint32_t>     matches;
+    std::unique_ptr<ExplorerFilterJob> filter;
+    size_t               selected;
+    size_t               scroll;
+    bool                 visible;
+    bool                 focused;
+};
+
+uint64_t explorer_char_mask(const char* data, size_t length);
+int      explorer_fuzzy_score(const char* path, size_t length, size_t name, const char* query, size_t queryLength);
+bool     explorer_list(const String& root, const String& directory, DirectoryListing& listing);
+void     explorer_scan_start(ExplorerScan& scan, const String& root);
+void     explorer_scan_stop(ExplorerScan& scan);
+void     explorer_scanner_run(ExplorerScan* scan);
+void     explorer_watcher_run(ExplorerScan* scan);
+void     explorer_filter_run(ExplorerFilterJob* job);
+
+void     explorer_initialize(Explorer& explorer);
+void     explorer_open(Explorer& explorer, const String& root);
+void     explorer_close(Explorer& explorer);
+void     explorer_poll(Explorer& explorer);
+bool     explorer_is_scanning(const Explorer& explorer);
+void     explorer_set_query(Explorer& explorer, const String& query);
+size_t   explorer_row_count(const Explorer& explorer);
+const ExplorerSnapshot* explorer_row_snapshot(const Explorer& explorer);
+const ExplorerNode* explorer_row(const Explorer& explorer, size_t row);
+const char* explorer_node_path(const ExplorerSnapshot& snapshot, const ExplorerNode& node);
+void     explorer_select(Explorer& explorer, long long delta);
+bool     explorer_activate(Explorer& explorer, String& path);
@@ -0,0 +1,150 @@
+#include "file_io.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+bool file_map(FileMapping& file, const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return false;
+    }
+    if (!S_ISREG(info.st_mode)) {
+        close(fd);
+        errno = S_ISDIR(info.st_mode) ? EISDIR : EINVAL;
+        return false;
+    }
+
+    file.data  = nullptr;
+    file.size  = info.st_size;
+    file.mtime = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+    if (file.size > 0) {
+        void* data = mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        file.data = (const char*)data;
+    }
+
+    close(fd);
+    return true;
+}
+
+void file_unmap(FileMapping& file) {
+    if (file.data != nullptr) {
+        munmap((void*)file.data, file.size);
+    }
+    file.data  = nullptr;
+    file.size  = 0;
+    file.mtime = 0;
+}
+
+bool file_stamp(FileStamp& stamp, const char* path) {
+    struct stat info;
+    if (stat(path, &info) != 0) return false;
+
+    stamp.size  = info.st_size;
+    stamp.mtime = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+    return true;
+}
+
+void line_index_scan(const char* data, size_t begin, size_t end, Vector<size_t>& newlines) {
+    for (const char* nl = data + begin; (nl = (const char*)memchr(nl, '\n', data + end - nl)) != nullptr; nl++) {
+        newlines.push_back(nl - data);
+    }
+}
+
+void line_indexer_run(LineIndexer* indexer, const char* data, size_t from, size_t size) {
+    Vector<size_t> newlines;
+    for (size_t begin = from; begin < size && !indexer->cancelled; begin += LINE_INDEX_CHUNK) {
+        size_t end = std::min(size, begin + LINE_INDEX_CHUNK);
+        newlines.clear();
+        line_index_scan(data, begin, end, newlines);
+
+        std::lock_guard<std::mutex> lock(indexer->mutex);
+        indexer->pending.insert(indexer->pending.end(), newlines.begin(), newlines.end());
+        indexer->indexed = end;
+    }
+
+    std::lock_guard<std::mutex> lock(indexer->mutex);
+    indexer->finished = true;
+}
+
+bool file_writer_write(FileWriter* writer, int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t count = write(fd, data, std::min(length, SAVE_WRITE_CHUNK));
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data            += count;
+        length          -= count;
+        writer->written += count;
+    }
+    return true;
+}
+
+void file_writer_sync_directory(const String& path) {
+    size_t slash = path.find_last_of('/');
+    String directory = slash == String::npos ? "." : path.substr(0, std::max((size_t)1, slash));
+
+    int fd = open(directory.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+void file_writer_run(FileWriter* writer) {
+    const TextSnapshot& snapshot = writer->snapshot;
+    String tmpName = writer->path + ".XXXXXX";
+    int    failure = 0;
+
+    // mkstemp creates a file nobody else has, so only a file this save made is ever removed.
+    int fd = mkstemp(&tmpName[0]);
+    if (fd < 0) failure = errno;
+    if (!failure && fchmod(fd, writer->mode) != 0) failure = errno;
+
+    // Small pieces are gathered into `staging`; pieces at least that large go straight out.
+    String staging;
+    staging.reserve(SAVE_STAGING_SIZE);
+    for (size_t idx = 0; idx < snapshot.pieces.size() && !failure; idx++) {
+        const Piece& piece = snapshot.pieces[idx];
+        const char*  data  = text_snapshot_piece_data(snapshot, piece);
+
+        if (staging.size() + piece.length > SAVE_STAGING_SIZE) {
+            if (!file_writer_write(writer, fd, staging.data(), staging.size())) failure = errno;
+            staging.clear();
+        }
+        if (piece.length >= SAVE_STAGING_SIZE) {
+            if (!failure && !file_writer_write(writer, fd, data, piece.length)) failure = errno;
+        } else {
+            staging.append(data, piece.length);
+        }
+    }
+    staging.push_back('\n');
+
+    if (!failure && !file_writer_write(writer, fd, staging.data(), staging.size())) failure = errno;
+    if (!failure && fsync(fd) != 0) failure = errno;
+    if (fd >= 0 && close(fd) != 0 && !failure) failure = errno;
+    if (!failure && rename(tmpName.c_str(), writer->path.c_str()) != 0) failure = errno;
+
+    if (failure && fd >= 0) {
+        unlink(tmpName.c_str());
+    } else {
+        file_writer_sync_directory(writer->path);
+    }
+
+    std::lock_guard<std::mutex> lock(writer->mutex);
+    writer->error    = failure ? strerror(failure) : "";
+    writer->finished = true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "text_engine.hpp"
+
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+struct FileMapping {
+    const char*          data;
+    size_t               size;
+    int64_t              mtime;
+};
+
+// Size and modification time in nanoseconds of a file on disk; tells whether it is
+// still the file a buffer was loaded from or last saved to.
+struct FileStamp {
+    size_t               size;
+    int64_t              mtime;
+};
+
+const size_t LINE_INDEX_FIRST_SCREEN = 1 << 20;
+const size_t LINE_INDEX_CHUNK        = 4 << 20;
+
+// Builds the newline index of a mapped file on a worker thread. The worker only
+// touches `pending`; the render thread moves it into the TextEngine once per frame.
+struct LineIndexer {
+    std::thread          worker;
+    std::mutex           mutex;
+    std::atomic<bool>    cancelled;
+    Vector<size_t>       pending;
+    size_t               indexed;
+    bool                 finished;
+};
+
+const size_t SAVE_STAGING_SIZE = 1 << 20;
+const size_t SAVE_WRITE_CHUNK  = 8 << 20;
+
+// Writes a TextSnapshot to `path` on a worker thread: large write(2) calls into a
+// uniquely named sibling temp file, then fsync and rename, so a crash never leaves a
+// truncated file.
+struct FileWriter {
+    std::thread          worker;
+    std::mutex           mutex;
+    TextSnapshot         snapshot;
+    String               path;
+    mode_t               mode;
+    std::atomic<size_t>  written;
+    size_t               total;
+    size_t               version;
+    bool                 finished;
+    String               error;
+};
+
+bool file_map(FileMapping& file, const char* path);
+void file_unmap(FileMapping& file);
+bool file_stamp(FileStamp& stamp, const char* path);
+void line_index_scan(const char* data, size_t begin, size_t end, Vector<size_t>& newlines);
+void line_indexer_run(LineIndexer* indexer, const char* data, size_t from, size_t size);
+void file_writer_run(FileWriter* writer);
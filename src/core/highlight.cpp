@@ -0,0 +1,393 @@
+#include "highlight.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+enum CppState : uint8_t { CPP_NORMAL, CPP_BLOCK_COMMENT, CPP_LINE_COMMENT, CPP_STRING, CPP_PREPROCESSOR };
+
+// Both tables are sorted for highlight_find_word.
+const char* const CPP_KEYWORDS[] = {
+    "alignas", "alignof", "asm", "auto", "break", "case", "catch", "class", "const", "const_cast",
+    "constexpr", "continue", "decltype", "default", "delete", "do", "dynamic_cast", "else", "enum",
+    "explicit", "export", "extern", "false", "final", "for", "friend", "goto", "if", "inline",
+    "mutable", "namespace", "new", "noexcept", "nullptr", "operator", "override", "private",
+    "protected", "public", "register", "reinterpret_cast", "return", "sizeof", "static",
+    "static_assert", "static_cast", "struct", "switch", "template", "this", "thread_local", "throw",
+    "true", "try", "typedef", "typeid", "typename", "union", "using", "virtual", "volatile", "while"
+};
+
+const char* const CPP_TYPES[] = {
+    "bool", "char", "char16_t", "char32_t", "double", "float", "int", "int16_t", "int32_t",
+    "int64_t", "int8_t", "intptr_t", "long", "ptrdiff_t", "short", "signed", "size_t", "ssize_t",
+    "uint16_t", "uint32_t", "uint64_t", "uint8_t", "uintptr_t", "unsigned", "void", "wchar_t"
+};
+
+const char* const CPP_EXTENSIONS[] = { ".c", ".h", ".cc", ".cpp", ".cxx", ".hh", ".hpp", ".hxx", nullptr };
+
+const Language LANGUAGES[] = {
+    { "c++", CPP_EXTENSIONS, &highlight_lex_cpp },
+};
+
+const Language* highlight_language_for(const String& path) {
+    for (const Language& language : LANGUAGES) {
+        for (const char* const* extension = language.extensions; *extension != nullptr; extension++) {
+            size_t length = strlen(*extension);
+            if (path.size() > length && path.compare(path.size() - length, length, *extension) == 0) {
+                return &language;
+            }
+        }
+    }
+    return nullptr;
+}
+
+bool highlight_find_word(const char* const* words, size_t count, const char* word, size_t length) {
+    size_t lo = 0;
+    size_t hi = count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        int    cmp = strncmp(words[mid], word, length);
+        if (cmp == 0) cmp = words[mid][length] == '\0' ? 0 : 1;
+        if (cmp == 0) return true;
+        if (cmp < 0) lo = mid + 1; else hi = mid;
+    }
+    return false;
+}
+
+void highlight_push(Vector<HighlightSpan>& spans, size_t begin, size_t end, TokenKind kind) {
+    if (begin >= end) return;
+    if (!spans.empty() && spans.back().kind == kind && spans.back().column + spans.back().length == begin) {
+        spans.back().length += end - begin;
+        return;
+    }
+    HighlightSpan span;
+    span.column = begin;
+    span.length = end - begin;
+    span.kind   = kind;
+    spans.push_back(span);
+}
+
+bool highlight_is_word(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+bool highlight_continues(const char* data, size_t length) {
+    return length > 0 && data[length - 1] == '\\';
+}
+
+// Index just past the closing `quote`, or `length` when the literal runs off the line.
+size_t highlight_skip_literal(const char* data, size_t length, size_t idx, char quote) {
+    for (; idx < length; idx++) {
+        if (data[idx] == '\\') idx++;
+        else if (data[idx] == quote) return idx + 1;
+    }
+    return length;
+}
+
+uint8_t highlight_lex_cpp(uint8_t state, const char* data, size_t length, Vector<HighlightSpan>& spans) {
+    size_t idx = 0;
+    switch (state) {
+        case CPP_LINE_COMMENT:
+            highlight_push(spans, 0, length, TokenKind::COMMENT);
+            return highlight_continues(data, length) ? CPP_LINE_COMMENT : CPP_NORMAL;
+        case CPP_PREPROCESSOR:
+            highlight_push(spans, 0, length, TokenKind::PREPROCESSOR);
+            return highlight_continues(data, length) ? CPP_PREPROCESSOR : CPP_NORMAL;
+        case CPP_STRING:
+            idx = highlight_skip_literal(data, length, 0, '"');
+            highlight_push(spans, 0, idx, TokenKind::STRING);
+            if (idx == length && (length == 0 || data[length - 1] != '"')) {
+                return highlight_continues(data, length) ? CPP_STRING : CPP_NORMAL;
+            }
+            break;
+        case CPP_BLOCK_COMMENT: {
+            const char* end = length >= 2 ? (const char*)memmem(data, length, "*/", 2) : nullptr;
+            if (end == nullptr) {
+                highlight_push(spans, 0, length, TokenKind::COMMENT);
+                return CPP_BLOCK_COMMENT;
+            }
+            idx = end - data + 2;
+            highlight_push(spans, 0, idx, TokenKind::COMMENT);
+            break;
+        }
+        default:
+            break;
+    }
+
+    size_t first = idx;
+    while (first < length && (data[first] == ' ' || data[first] == '\t')) first++;
+    if (state == CPP_NORMAL && first < length && data[first] == '#') {
+        const char* comment = (const char*)memmem(data + first, length - first, "//", 2);
+        size_t      end     = comment ? comment - data : length;
+        highlight_push(spans, first, end, TokenKind::PREPROCESSOR);
+        highlight_push(spans, end, length, TokenKind::COMMENT);
+        return highlight_continues(data, length) ? (comment ? CPP_LINE_COMMENT : CPP_PREPROCESSOR) : CPP_NORMAL;
+    }
+
+    while (idx < length) {
+        char   c     = data[idx];
+        char   next  = idx + 1 < length ? data[idx + 1] : '\0';
+        size_t start = idx;
+
+        if (c == '/' && next == '/') {
+            highlight_push(spans, idx, length, TokenKind::COMMENT);
+            return highlight_continues(data, length) ? CPP_LINE_COMMENT : CPP_NORMAL;
+        }
+        if (c == '/' && next == '*') {
+            const char* end = idx + 2 < length ? (const char*)memmem(data + idx + 2, length - idx - 2, "*/", 2) : nullptr;
+            if (end == nullptr) {
+                highlight_push(spans, idx, length, TokenKind::COMMENT);
+                return CPP_BLOCK_COMMENT;
+            }
+            idx = end - data + 2;
+            highlight_push(spans, start, idx, TokenKind::COMMENT);
+        } else if (c == '"' || c == '\'') {
+            idx = highlight_skip_literal(data, length, idx + 1, c);
+            highlight_push(spans, start, idx, TokenKind::STRING);
+            if (c == '"' && idx == length && data[length - 1] != '"' && highlight_continues(data, length)) {
+                return CPP_STRING;
+            }
+        } else if ((c >= '0' && c <= '9') || (c == '.' && next >= '0' && next <= '9')) {
+            for (idx++; idx < length; idx++) {
+                char d = data[idx];
+                bool exponentSign = (d == '+' || d == '-') && strchr("eEpP", data[idx - 1]) != nullptr;
+                if (!highlight_is_word(d) && d != '.' && d != '\'' && !exponentSign) break;
+            }
+            highlight_push(spans, start, idx, TokenKind::NUMBER);
+        } else if (highlight_is_word(c)) {
+            while (idx < length && highlight_is_word(data[idx])) idx++;
+            if (highlight_find_word(CPP_KEYWORDS, sizeof(CPP_KEYWORDS) / sizeof(*CPP_KEYWORDS), data + start, idx - start)) {
+                highlight_push(spans, start, idx, TokenKind::KEYWORD);
+            } else if (highlight_find_word(CPP_TYPES, sizeof(CPP_TYPES) / sizeof(*CPP_TYPES), data + start, idx - start)) {
+                highlight_push(spans, start, idx, TokenKind::TYPE);
+            }
+        } else {
+            idx++;
+        }
+    }
+    return CPP_NORMAL;
+}
+
+void highlight_initialize(Highlight& highlight) {
+    highlight.language   = nullptr;
+    highlight.result.reset();
+    highlight.job.reset();
+    highlight.dirtyFrom  = SIZE_MAX;
+    highlight.dirtyTo    = 0;
+    highlight.lineDelta  = 0;
+    highlight.staleFrom  = SIZE_MAX;
+    highlight.staleTo    = 0;
+    highlight.staleDelta = 0;
+}
+
+// Lines [line, line + removedLines] were replaced by [line, line + insertedLines]. The
+// range grows to cover them and shifts with the lines after the edit.
+void highlight_widen(size_t& from, size_t& to, long long& delta, size_t line, size_t removedLines, size_t insertedLines) {
+    size_t end = line + insertedLines + 1;
+    if (from == SIZE_MAX) {
+        from  = line;
+        to    = end;
+        delta = (long long)insertedLines - (long long)removedLines;
+        return;
+    }
+
+    if (to != HIGHLIGHT_ALL_LINES) {
+        size_t shifted = to > line + removedLines ? to + insertedLines - removedLines : to;
+        to = std::max(shifted, end);
+    }
+    from   = std::min(from, line);
+    delta += (long long)insertedLines - (long long)removedLines;
+}
+
+void highlight_note_edit(Highlight& highlight, size_t line, size_t removedLines, size_t insertedLines) {
+    highlight_widen(highlight.dirtyFrom, highlight.dirtyTo, highlight.lineDelta, line, removedLines, insertedLines);
+    highlight_widen(highlight.staleFrom, highlight.staleTo, highlight.staleDelta, line, removedLines, insertedLines);
+}
+
+void highlight_invalidate(Highlight& highlight) {
+    highlight.dirtyFrom  = 0;
+    highlight.dirtyTo    = HIGHLIGHT_ALL_LINES;
+    highlight.lineDelta  = 0;
+    highlight.staleFrom  = 0;
+    highlight.staleTo    = HIGHLIGHT_ALL_LINES;
+    highlight.staleDelta = 0;
+}
+
+void highlight_cancel(Highlight& highlight) {
+    if (highlight.job) {
+        highlight.job->cancelled = true;
+        highlight.job->worker.join();
+        highlight.job.reset();
+    }
+}
+
+struct HighlightLexer {
+    HighlightJob*        job;
+    HighlightResult*     result;
+    const HighlightResult* base;
+    uint8_t              state;
+    size_t               line;
+    String               text;
+    Vector<HighlightSpan> lineSpans;
+    bool                 done;
+};
+
+// Lexes the line collected in `lexer.text`, then checks whether the rest of the base
+// result can be reused as is.
+void highlight_finish_line(HighlightLexer& lexer) {
+    HighlightResult& result = *lexer.result;
+    lexer.lineSpans.clear();
+    lexer.state = lexer.job->language->lexLine(lexer.state, lexer.text.data(), lexer.text.size(), lexer.lineSpans);
+    result.spans.insert(result.spans.end(), lexer.lineSpans.begin(), lexer.lineSpans.end());
+    result.states.push_back(lexer.state);
+    result.lineSpans.push_back(result.spans.size());
+    lexer.text.clear();
+
+    const HighlightResult* base = lexer.base;
+    long long old = (long long)lexer.line - lexer.job->lineDelta;
+    lexer.line++;
+    if (base == nullptr || lexer.job->to == HIGHLIGHT_ALL_LINES || lexer.line <= lexer.job->to) return;
+    if (old < 0 || (size_t)old >= base->states.size() || base->states[old] != lexer.state) return;
+
+    size_t firstSpan = base->lineSpans[old + 1];
+    size_t shift     = result.spans.size() - firstSpan;
+    result.spans.insert(result.spans.end(), base->spans.begin() + firstSpan, base->spans.end());
+    result.states.insert(result.states.end(), base->states.begin() + old + 1, base->states.end());
+    for (size_t idx = old + 2; idx < base->lineSpans.size(); idx++) {
+        result.lineSpans.push_back(base->lineSpans[idx] + shift);
+    }
+    lexer.done = true;
+}
+
+void highlight_job_run(HighlightJob* job) {
+    std::shared_ptr<HighlightResult> result(new HighlightResult());
+    const HighlightResult* base = job->base.get();
+
+    HighlightLexer lexer;
+    lexer.job    = job;
+    lexer.result = result.get();
+    lexer.base   = base;
+    lexer.state  = 0;
+    lexer.line   = base ? job->from : 0;
+    lexer.done   = false;
+
+    result->lineSpans.push_back(0);
+    if (lexer.line > 0) {
+        result->states.assign(base->states.begin(), base->states.begin() + lexer.line);
+        result->lineSpans.assign(base->lineSpans.begin(), base->lineSpans.begin() + lexer.line + 1);
+        result->spans.assign(base->spans.begin(), base->spans.begin() + base->lineSpans[lexer.line]);
+        lexer.state = base->states[lexer.line - 1];
+    }
+
+    size_t begin  = base ? job->fromOffset : 0;
+    size_t offset = 0;
+    for (const Piece& piece : job->snapshot.pieces) {
+        if (lexer.done) break;
+        if (offset + piece.length <= begin) {
+            offset += piece.length;
+            continue;
+        }
+
+        const char* data  = text_snapshot_piece_data(job->snapshot, piece);
+        size_t      skip  = begin > offset ? begin - offset : 0;
+        size_t      count = piece.length - skip;
+        data   += skip;
+        offset += piece.length;
+
+        while (count > 0 && !lexer.done) {
+            const char* newline = (const char*)memchr(data, '\n', count);
+            size_t      length  = newline ? newline - data : count;
+            lexer.text.append(data, length);
+            if (newline == nullptr) break;
+
+            highlight_finish_line(lexer);
+            data  += length + 1;
+            count -= length + 1;
+            if (lexer.line % HIGHLIGHT_CANCEL_LINES == 0 && job->cancelled) {
+                job->finished = true;
+                return;
+            }
+        }
+    }
+    if (!lexer.done) highlight_finish_line(lexer);
+
+    result->version = job->version;
+    job->result     = result;
+    job->finished   = true;
+}
+
+// Collects a finished job and starts the next one when there are edits left to lex.
+void highlight_poll(Highlight& highlight, const TextEngine& text) {
+    if (highlight.job && highlight.job->finished) {
+        highlight.job->worker.join();
+        if (highlight.job->result) {
+            // The job lexed the text as it was when it started: only edits made since are stale.
+            highlight.result     = highlight.job->result;
+            highlight.staleFrom  = highlight.dirtyFrom;
+            highlight.staleTo    = highlight.dirtyTo;
+            highlight.staleDelta = highlight.lineDelta;
+        }
+        highlight.job.reset();
+    }
+    if (highlight.language == nullptr || highlight.job || highlight.dirtyFrom == SIZE_MAX) return;
+
+    highlight.job.reset(new HighlightJob());
+    HighlightJob& job = *highlight.job;
+    job.cancelled = false;
+    job.finished  = false;
+    job.language  = highlight.language;
+    job.base      = highlight.result;
+    job.from      = highlight.dirtyFrom;
+    job.to        = highlight.dirtyTo;
+    job.lineDelta = highlight.lineDelta;
+    job.version   = text.version;
+
+    // Lines before `from` are unchanged, so the base has them; anything else starts over.
+    if (!job.base || job.from >= text.lineCount || job.from > job.base->states.size()) {
+        job.base.reset();
+        job.from = 0;
+        job.to   = HIGHLIGHT_ALL_LINES;
+    }
+    job.fromOffset = text_line_start(text, job.from);
+    text_snapshot(text, job.snapshot);
+
+    highlight.dirtyFrom = SIZE_MAX;
+    highlight.dirtyTo   = 0;
+    highlight.lineDelta = 0;
+    job.worker = std::thread(&highlight_job_run, &job);
+}
+
+const HighlightSpan* highlight_line_spans(const Highlight& highlight, size_t line, size_t& count) {
+    count = 0;
+    // Past the stale range lines only moved; inside it the old spans of the same row are
+    // the best guess until the next result arrives.
+    if (highlight.staleFrom != SIZE_MAX && highlight.staleTo != HIGHLIGHT_ALL_LINES && line >= highlight.staleTo) {
+        line -= highlight.staleDelta;
+    }
+    if (!highlight.result || line >= highlight.result->states.size()) return nullptr;
+
+    const HighlightResult& result = *highlight.result;
+    count = result.lineSpans[line + 1] - result.lineSpans[line];
+    return result.spans.data() + result.lineSpans[line];
+}
+
+// FNV-1a over the spans of `line`; two renders of a line with the same hash look the same.
+uint32_t highlight_line_hash(const Highlight& highlight, size_t line) {
+    size_t count;
+    const HighlightSpan* spans = highlight_line_spans(highlight, line, count);
+
+    uint32_t hash = 2166136261u;
+    for (size_t idx = 0; idx < count; idx++) {
+        uint32_t words[3] = { spans[idx].column, spans[idx].length, (uint32_t)spans[idx].kind };
+        for (uint32_t word : words) {
+            hash = (hash ^ word) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+size_t highlight_memory_footprint(const Highlight& highlight) {
+    if (!highlight.result) return 0;
+
+    const HighlightResult& result = *highlight.result;
+    return result.states.capacity() + result.lineSpans.capacity() * sizeof(uint32_t) + result.spans.capacity() * sizeof(HighlightSpan);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "text_engine.hpp"
+
+#include <cstdint>
+#include <thread>
+#include <atomic>
+#include <memory>
+
+enum class TokenKind : uint8_t { TEXT, KEYWORD, TYPE, NUMBER, STRING, COMMENT, PREPROCESSOR };
+
+// Columns [column, column + length) of a line are drawn as `kind`; the gaps are TEXT.
+struct HighlightSpan {
+    uint32_t             column;
+    uint32_t             length;
+    TokenKind            kind;
+};
+
+// Lexes one line starting in `state` and returns the state at its end, which is all
+// that carries over to the next line.
+typedef uint8_t (*LineLexer)(uint8_t state, const char* data, size_t length, Vector<HighlightSpan>& spans);
+
+struct Language {
+    const char*          name;
+    const char* const*   extensions;
+    LineLexer            lexLine;
+};
+
+// Spans of every line plus the lexer state at the end of each line, for the text at
+// `version`. Never changed once published, so the render thread reads it without locks
+// while a job builds the next one from it.
+struct HighlightResult {
+    Vector<uint8_t>      states;
+    Vector<uint32_t>     lineSpans;
+    Vector<HighlightSpan> spans;
+    size_t               version;
+};
+
+const size_t HIGHLIGHT_CANCEL_LINES = 4096;
+const size_t HIGHLIGHT_ALL_LINES    = SIZE_MAX;
+
+// Re-lexes a TextSnapshot from line `from` on a worker thread. Lines up to `to` changed;
+// past it, old line `line - lineDelta` of `base` is the same text, so lexing stops as
+// soon as a line ends in the state `base` recorded for it.
+struct HighlightJob {
+    std::thread          worker;
+    std::atomic<bool>    cancelled;
+    std::atomic<bool>    finished;
+    TextSnapshot         snapshot;
+    const Language*      language;
+    std::shared_ptr<const HighlightResult> base;
+    size_t               from;
+    size_t               fromOffset;
+    size_t               to;
+    long long            lineDelta;
+    size_t               version;
+    std::shared_ptr<const HighlightResult> result;
+};
+
+// Per-buffer highlighting state, owned by the render thread. Edits widen the dirty
+// range [dirtyFrom, dirtyTo) until the next job picks it up, and the stale range, which
+// covers every edit since `result` was lexed, so its lines can still be drawn meanwhile.
+struct Highlight {
+    const Language*      language;
+    std::shared_ptr<const HighlightResult> result;
+    std::unique_ptr<HighlightJob> job;
+    size_t               dirtyFrom;
+    size_t               dirtyTo;
+    long long            lineDelta;
+    size_t               staleFrom;
+    size_t               staleTo;
+    long long            staleDelta;
+};
+
+const Language* highlight_language_for(const String& path);
+uint8_t  highlight_lex_cpp(uint8_t state, const char* data, size_t length, Vector<HighlightSpan>& spans);
+
+void     highlight_initialize(Highlight& highlight);
+void     highlight_note_edit(Highlight& highlight, size_t line, size_t removedLines, size_t insertedLines);
+void     highlight_invalidate(Highlight& highlight);
+void     highlight_cancel(Highlight& highlight);
+void     highlight_job_run(HighlightJob* job);
+void     highlight_poll(Highlight& highlight, const TextEngine& text);
+const HighlightSpan* highlight_line_spans(const Highlight& highlight, size_t line, size_t& count);
+uint32_t highlight_line_hash(const Highlight& highlight, size_t line);
+size_t   highlight_memory_footprint(const Highlight& highlight);
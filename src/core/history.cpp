@@ -0,0 +1,97 @@
+#include "history.hpp"
+
+size_t edit_footprint(const Edit& edit) {
+    return sizeof(Edit) + edit.pieces.capacity() * sizeof(Piece);
+}
+
+void history_initialize(UndoHistory& history) {
+    history.undo.clear();
+    history.redo.clear();
+    history.bytes  = 0;
+    history.sealed = true;
+}
+
+bool history_same_cursor(const Position& a, const Position& b) {
+    return a.x == b.x && a.y == b.y;
+}
+
+// Keystrokes that continue the previous edit right where it left the cursor are folded
+// into it, so a run of typing or backspacing is a single entry.
+Edit* history_coalesce_target(UndoHistory& history, EditKind kind, const Position& cursorBefore) {
+    if (history.sealed || history.undo.empty()) return nullptr;
+
+    Edit& last = history.undo.back();
+    if (last.kind != kind || !history_same_cursor(last.cursorAfter, cursorBefore)) return nullptr;
+    return &last;
+}
+
+void history_push(UndoHistory& history, Edit& edit) {
+    for (const Edit& dropped : history.redo) {
+        history.bytes -= edit_footprint(dropped);
+    }
+    history.redo.clear();
+
+    history.bytes += edit_footprint(edit);
+    history.undo.push_back(std::move(edit));
+    while (history.bytes > history.budget && history.undo.size() > 1) {
+        history.bytes -= edit_footprint(history.undo.front());
+        history.undo.pop_front();
+    }
+    history.sealed = false;
+}
+
+void history_record_insert(UndoHistory& history, size_t offset, const Piece& piece, const Position& cursorBefore, const Position& cursorAfter) {
+    Edit* last = history_coalesce_target(history, EditKind::INSERT, cursorBefore);
+    if (last != nullptr && last->offset + last->length == offset) {
+        history.bytes -= edit_footprint(*last);
+        Piece& tail = last->pieces.back();
+        if (tail.source == piece.source && tail.start + tail.length == piece.start) {
+            tail.length += piece.length;
+        } else {
+            last->pieces.push_back(piece);
+        }
+        last->length     += piece.length;
+        last->cursorAfter = cursorAfter;
+        history.bytes += edit_footprint(*last);
+        return;
+    }
+
+    Edit edit;
+    edit.kind         = EditKind::INSERT;
+    edit.offset       = offset;
+    edit.length       = piece.length;
+    edit.cursorBefore = cursorBefore;
+    edit.cursorAfter  = cursorAfter;
+    edit.pieces.push_back(piece);
+    history_push(history, edit);
+}
+
+void history_record_erase(UndoHistory& history, size_t offset, size_t length, const Vector<Piece>& removed, const Position& cursorBefore, const Position& cursorAfter) {
+    if (removed.empty()) return;
+
+    Edit* last = history_coalesce_target(history, EditKind::ERASE, cursorBefore);
+    if (last != nullptr && offset + length == last->offset) {
+        history.bytes -= edit_footprint(*last);
+        Piece& head = last->pieces.front();
+        if (removed.size() == 1 && removed[0].source == head.source && removed[0].start + removed[0].length == head.start) {
+            head.start  -= removed[0].length;
+            head.length += removed[0].length;
+        } else {
+            last->pieces.insert(last->pieces.begin(), removed.begin(), removed.end());
+        }
+        last->offset      = offset;
+        last->length     += length;
+        last->cursorAfter = cursorAfter;
+        history.bytes += edit_footprint(*last);
+        return;
+    }
+
+    Edit edit;
+    edit.kind         = EditKind::ERASE;
+    edit.offset       = offset;
+    edit.length       = length;
+    edit.pieces       = removed;
+    edit.cursorBefore = cursorBefore;
+    edit.cursorAfter  = cursorAfter;
+    history_push(history, edit);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "text_engine.hpp"
+
+#include <deque>
+
+enum class EditKind { INSERT, ERASE };
+
+// One undoable change. The text is kept as piece references into the append-only
+// sources rather than as bytes, so an entry costs a few words whatever its size.
+struct Edit {
+    EditKind             kind;
+    size_t               offset;
+    size_t               length;
+    Vector<Piece>        pieces;
+    Position             cursorBefore;
+    Position             cursorAfter;
+};
+
+const size_t UNDO_DEFAULT_BUDGET = 8 << 20;
+
+struct UndoHistory {
+    std::deque<Edit>     undo;
+    Vector<Edit>         redo;
+    size_t               bytes;
+    size_t               budget;
+    bool                 sealed;
+};
+
+void history_initialize(UndoHistory& history);
+void history_record_insert(UndoHistory& history, size_t offset, const Piece& piece, const Position& cursorBefore, const Position& cursorAfter);
+void history_record_erase(UndoHistory& history, size_t offset, size_t length, const Vector<Piece>& removed, const Position& cursorBefore, const Position& cursorAfter);
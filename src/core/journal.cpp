@@ -0,0 +1,383 @@
+#include "journal.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock JournalClock;
+
+// "dir/name" journals to "dir/.name.journal", next to the file it protects.
+String journal_path(const String& path) {
+    size_t slash = path.find_last_of('/');
+    if (slash == String::npos) return "." + path + ".journal";
+    return path.substr(0, slash + 1) + "." + path.substr(slash + 1) + ".journal";
+}
+
+uint32_t journal_checksum(const char* data, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t idx = 0; idx < length; idx++) {
+        hash = (hash ^ (unsigned char)data[idx]) * 16777619u;
+    }
+    return hash;
+}
+
+void journal_put_varint(String& out, size_t value) {
+    while (value >= 0x80) {
+        out.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+void journal_put_u64(String& out, uint64_t value) {
+    for (int shift = 0; shift < 64; shift += 8) out.push_back((char)(value >> shift));
+}
+
+void journal_put_checksum(String& out, size_t recordStart) {
+    uint32_t checksum = journal_checksum(out.data() + recordStart, out.size() - recordStart);
+    for (int shift = 0; shift < 32; shift += 8) out.push_back((char)(checksum >> shift));
+}
+
+// Called with the lock held once the record at `start` of `pending` is complete. The
+// worker is woken by the first record of a batch, and again once the batch is full.
+void journal_commit(Journal& journal, size_t start) {
+    if (journal.capturing) journal.captured.append(journal.pending, start, String::npos);
+    if (start == 0 || journal.pending.size() >= JOURNAL_BATCH_SIZE) journal.wake.notify_one();
+}
+
+// Called on the render thread for every edit; the lock is only ever contended for the
+// moment it takes the worker to swap buffers.
+void journal_insert(Journal& journal, size_t offset, const char* data, size_t length) {
+    std::lock_guard<std::mutex> lock(journal.mutex);
+    String& out   = journal.pending;
+    size_t  start = out.size();
+    out.push_back((char)JournalOp::INSERT);
+    journal_put_varint(out, offset);
+    journal_put_varint(out, length);
+    out.append(data, length);
+    journal_put_checksum(out, start);
+    journal_commit(journal, start);
+}
+
+void journal_erase(Journal& journal, size_t offset, size_t length) {
+    std::lock_guard<std::mutex> lock(journal.mutex);
+    String& out   = journal.pending;
+    size_t  start = out.size();
+    out.push_back((char)JournalOp::ERASE);
+    journal_put_varint(out, offset);
+    journal_put_varint(out, length);
+    journal_put_checksum(out, start);
+    journal_commit(journal, start);
+}
+
+void journal_capture(Journal& journal, bool capture) {
+    std::lock_guard<std::mutex> lock(journal.mutex);
+    journal.capturing = capture;
+    journal.captured.clear();
+}
+
+// Ends capturing and hands over the records captured so far.
+void journal_take_captured(Journal& journal, String& records) {
+    std::lock_guard<std::mutex> lock(journal.mutex);
+    records.swap(journal.captured);
+    journal.captured.clear();
+    journal.capturing = false;
+}
+
+// Appends complete records, as captured from another journal.
+void journal_append(Journal& journal, const String& records) {
+    if (records.empty()) return;
+
+    std::lock_guard<std::mutex> lock(journal.mutex);
+    size_t start = journal.pending.size();
+    journal.pending.append(records);
+    journal_commit(journal, start);
+}
+
+// `keep` is the intact length of a journal being resumed after recovery, 0 for a new one.
+void journal_start(Journal& journal, const String& path, const FileStamp& base, size_t keep) {
+    journal.path     = path;
+    journal.base     = base;
+    journal.keep     = keep;
+    journal.stopping  = false;
+    journal.reported  = false;
+    journal.capturing = false;
+    journal.captured.clear();
+    journal.worker   = std::thread(&journal_run, &journal);
+}
+
+// Flushes and syncs everything recorded so far, then removes the file if the buffer
+// no longer needs it (it was saved, or closed on purpose).
+void journal_stop(Journal& journal, bool remove) {
+    {
+        std::lock_guard<std::mutex> lock(journal.mutex);
+        journal.stopping = true;
+    }
+    journal.wake.notify_one();
+    journal.worker.join();
+    if (remove) unlink(journal.path.c_str());
+}
+
+bool journal_write(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t count = write(fd, data, length);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data   += count;
+        length -= count;
+    }
+    return true;
+}
+
+int journal_open(Journal* journal) {
+    if (journal->keep > 0) {
+        int fd = open(journal->path.c_str(), O_WRONLY);
+        if (fd >= 0 && (ftruncate(fd, journal->keep) != 0 || lseek(fd, 0, SEEK_END) < 0)) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    int fd = open(journal->path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) return -1;
+
+    String header(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    journal_put_u64(header, journal->base.size);
+    journal_put_u64(header, (uint64_t)journal->base.mtime);
+    if (!journal_write(fd, header.data(), header.size()) || fdatasync(fd) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void journal_run(Journal* journal) {
+    int fd = journal_open(journal);
+    int failure = fd < 0 ? errno : 0;
+
+    String writing;
+    bool   dirty    = false;
+    JournalClock::time_point lastSync = JournalClock::now();
+
+    std::unique_lock<std::mutex> lock(journal->mutex);
+    for (;;) {
+        // Idle until an edit arrives, or until an unsynced write is due for its fdatasync.
+        if (dirty) {
+            journal->wake.wait_for(lock, std::chrono::milliseconds(JOURNAL_SYNC_INTERVAL), [&] { return journal->stopping || !journal->pending.empty(); });
+        } else {
+            journal->wake.wait(lock, [&] { return journal->stopping || !journal->pending.empty(); });
+        }
+        // Group commit: give a burst of keystrokes the chance to share one write.
+        journal->wake.wait_for(lock, std::chrono::milliseconds(JOURNAL_WRITE_INTERVAL), [&] { return journal->stopping || journal->pending.size() >= JOURNAL_BATCH_SIZE; });
+
+        writing.swap(journal->pending);
+        journal->pending.clear();
+        bool stopping = journal->stopping;
+        lock.unlock();
+
+        if (!failure && !writing.empty()) {
+            if (journal_write(fd, writing.data(), writing.size())) dirty = true; else failure = errno;
+        }
+        writing.clear();
+
+        JournalClock::time_point now = JournalClock::now();
+        if (!failure && dirty && (stopping || now - lastSync >= std::chrono::milliseconds(JOURNAL_SYNC_INTERVAL))) {
+            if (fdatasync(fd) != 0) failure = errno;
+            dirty    = false;
+            lastSync = now;
+        }
+
+        lock.lock();
+        if (failure && journal->error.empty()) journal->error = strerror(failure);
+        if (stopping) break;
+    }
+
+    if (fd >= 0) close(fd);
+}
+
+// Document text with a gap at the last edit, so replaying a long run of nearby edits
+// moves only the bytes between consecutive edit positions.
+struct GapText {
+    String               data;
+    size_t               gapStart;
+    size_t               gapEnd;
+};
+
+size_t gap_size(const GapText& text) {
+    return text.data.size() - (text.gapEnd - text.gapStart);
+}
+
+void gap_move(GapText& text, size_t offset) {
+    char* data = &text.data[0];
+    if (offset < text.gapStart) {
+        size_t count = text.gapStart - offset;
+        memmove(data + text.gapEnd - count, data + offset, count);
+        text.gapStart -= count;
+        text.gapEnd   -= count;
+    } else if (offset > text.gapStart) {
+        size_t count = offset - text.gapStart;
+        memmove(data + text.gapStart, data + text.gapEnd, count);
+        text.gapStart += count;
+        text.gapEnd   += count;
+    }
+}
+
+void gap_reserve(GapText& text, size_t length) {
+    if (text.gapEnd - text.gapStart >= length) return;
+
+    size_t grow = std::max(length, text.data.size() / 2 + 4096);
+    size_t tail = text.data.size() - text.gapEnd;
+    String next(text.data.size() + grow, '\0');
+    memcpy(&next[0], text.data.data(), text.gapStart);
+    memcpy(&next[next.size() - tail], text.data.data() + text.gapEnd, tail);
+    text.gapEnd = next.size() - tail;
+    text.data.swap(next);
+}
+
+bool journal_get_varint(const char*& in, const char* end, size_t& value) {
+    value = 0;
+    for (int shift = 0; in < end && shift < 64; shift += 7) {
+        unsigned char byte = *in++;
+        value |= (size_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+uint64_t journal_get_u64(const char* in) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 8) value |= (uint64_t)(unsigned char)*in++ << shift;
+    return value;
+}
+
+uint32_t journal_get_u32(const char* in) {
+    uint32_t value = 0;
+    for (int shift = 0; shift < 32; shift += 8) value |= (uint32_t)(unsigned char)*in++ << shift;
+    return value;
+}
+
+bool journal_read_file(const String& path, String& contents, String& error) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = strerror(errno);
+        return false;
+    }
+
+    char chunk[1 << 16];
+    for (;;) {
+        ssize_t count = read(fd, chunk, sizeof(chunk));
+        if (count < 0 && errno == EINTR) continue;
+        if (count < 0) {
+            error = strerror(errno);
+            close(fd);
+            return false;
+        }
+        if (count == 0) break;
+        contents.append(chunk, count);
+    }
+    close(fd);
+    return true;
+}
+
+// Reads the journal at `path` and parses its intact records. It must have been written
+// against the file described by `base`; parsing stops at the first damaged record, which
+// is where the process died mid-write.
+bool journal_read(const String& path, const FileStamp& base, String& contents, Vector<JournalRecord>& records, String& error) {
+    if (!journal_read_file(path, contents, error)) return false;
+
+    const char* begin = contents.data();
+    const char* end   = begin + contents.size();
+    if (contents.size() < JOURNAL_HEADER_SIZE || memcmp(begin, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0) {
+        error = "not a journal";
+        return false;
+    }
+    if (journal_get_u64(begin + 8) != base.size || (int64_t)journal_get_u64(begin + 16) != base.mtime) {
+        error = "the file changed since the journal was written";
+        return false;
+    }
+
+    for (const char* in = begin + JOURNAL_HEADER_SIZE; in < end;) {
+        const char*   start = in;
+        JournalRecord record;
+        record.op = (JournalOp)*in++;
+        if (record.op != JournalOp::INSERT && record.op != JournalOp::ERASE) break;
+        if (!journal_get_varint(in, end, record.offset) || !journal_get_varint(in, end, record.length)) break;
+
+        record.data = in;
+        if (record.op == JournalOp::INSERT) {
+            if ((size_t)(end - in) < record.length) break;
+            in += record.length;
+        }
+        if (end - in < 4 || journal_get_u32(in) != journal_checksum(start, in - start)) break;
+        in += 4;
+
+        record.end = in - begin;
+        records.push_back(record);
+    }
+    return true;
+}
+
+// Whether `record` can apply to a document of `size` bytes; the first one that cannot
+// ends the replay like a damaged record does.
+bool journal_record_fits(const JournalRecord& record, size_t size) {
+    return record.offset <= size && (record.op == JournalOp::INSERT || record.length <= size - record.offset);
+}
+
+// Applies the journal at `path` to `document`, which must hold the text of the file
+// described by `base`.
+bool journal_replay(const String& path, const FileStamp& base, String& document, JournalReplay& replay, String& error) {
+    String                contents;
+    Vector<JournalRecord> records;
+    if (!journal_read(path, base, contents, records, error)) return false;
+
+    GapText text;
+    text.data.swap(document);
+    text.gapStart = text.data.size();
+    text.gapEnd   = text.data.size();
+
+    replay.operations = 0;
+    replay.validSize  = JOURNAL_HEADER_SIZE;
+    for (const JournalRecord& record : records) {
+        if (!journal_record_fits(record, gap_size(text))) break;
+
+        if (record.op == JournalOp::INSERT) {
+            gap_reserve(text, record.length);
+            gap_move(text, record.offset);
+            memcpy(&text.data[text.gapStart], record.data, record.length);
+            text.gapStart += record.length;
+        } else {
+            gap_move(text, record.offset);
+            text.gapEnd += record.length;
+        }
+        replay.operations++;
+        replay.validSize = record.end;
+    }
+
+    gap_move(text, gap_size(text));
+    text.data.resize(text.gapStart);
+    document.swap(text.data);
+    return true;
+}
+
+// The recovered document is built here whole, add buffer and newline index included, so
+// the render thread only has to move it into the buffer.
+void journal_recovery_run(JournalRecovery* recovery) {
+    const TextSnapshot& snapshot = recovery->snapshot;
+    String document;
+    document.reserve(snapshot.size);
+    for (const Piece& piece : snapshot.pieces) {
+        document.append(text_snapshot_piece_data(snapshot, piece), piece.length);
+    }
+
+    recovery->replayed = journal_replay(recovery->path, recovery->base, document, recovery->replay, recovery->error);
+    if (recovery->replayed) {
+        text_initialize(recovery->text);
+        text_adopt(recovery->text, document);
+    }
+    recovery->finished = true;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "file_io.hpp"
+
+#include <condition_variable>
+
+const size_t   JOURNAL_BATCH_SIZE        = 64 << 10;
+const uint64_t JOURNAL_WRITE_INTERVAL    = 20;    // milliseconds
+const uint64_t JOURNAL_SYNC_INTERVAL     = 1000;  // milliseconds
+const size_t   JOURNAL_HEADER_SIZE       = 24;
+const size_t   JOURNAL_PIECE_REPLAY_SIZE = 64 << 10;
+const char     JOURNAL_MAGIC[8]          = { 'D', 'C', 'J', 'R', 'N', 'L', '0', '1' };
+
+// A journal file is a header (magic, then the size and mtime of the file its offsets
+// refer to) followed by records:
+//
+//   op:u8  offset:varint  length:varint  [length bytes if INSERT]  checksum:u32
+//
+// The checksum is FNV-1a of the record up to it, so a torn tail is detected and dropped.
+enum class JournalOp : uint8_t { INSERT = 1, ERASE = 2 };
+
+// Appends the edits of one buffer to its journal file. The render thread only encodes
+// records into `pending`; the worker writes whatever has accumulated in one write(2)
+// every JOURNAL_WRITE_INTERVAL and fdatasyncs at most every JOURNAL_SYNC_INTERVAL, so
+// a crash loses at most about a second of typing. While `capturing`, every record is
+// also kept in `captured`, which is how the edits made during a save are carried over.
+struct Journal {
+    std::thread          worker;
+    std::mutex           mutex;
+    std::condition_variable wake;
+    String               pending;
+    String               captured;
+    bool                 capturing;
+    String               path;
+    FileStamp            base;
+    size_t               keep;
+    bool                 stopping;
+    bool                 reported;
+    String               error;
+};
+
+// One intact record; `data` points into the contents it was parsed from and `end` is
+// the length of the journal up to and including it.
+struct JournalRecord {
+    JournalOp            op;
+    size_t               offset;
+    size_t               length;
+    const char*          data;
+    size_t               end;
+};
+
+// What journal_replay made of a journal; `validSize` is the length up to the last intact
+// record, which is where a resumed journal continues.
+struct JournalReplay {
+    size_t               operations;
+    size_t               validSize;
+};
+
+// Replays a journal too large to apply piece by piece on a worker thread: `snapshot` is
+// the text the journal refers to, `text` becomes the recovered document.
+struct JournalRecovery {
+    std::thread          worker;
+    std::atomic<bool>    finished;
+    String               path;
+    FileStamp            base;
+    TextSnapshot         snapshot;
+    TextEngine           text;
+    JournalReplay        replay;
+    bool                 replayed;
+    String               error;
+};
+
+String journal_path(const String& path);
+void   journal_start(Journal& journal, const String& path, const FileStamp& base, size_t keep);
+void   journal_insert(Journal& journal, size_t offset, const char* data, size_t length);
+void   journal_erase(Journal& journal, size_t offset, size_t length);
+void   journal_capture(Journal& journal, bool capture);
+void   journal_take_captured(Journal& journal, String& records);
+void   journal_append(Journal& journal, const String& records);
+void   journal_stop(Journal& journal, bool remove);
+void   journal_run(Journal* journal);
+bool   journal_read(const String& path, const FileStamp& base, String& contents, Vector<JournalRecord>& records, String& error);
+bool   journal_record_fits(const JournalRecord& record, size_t size);
+bool   journal_replay(const String& path, const FileStamp& base, String& document, JournalReplay& replay, String& error);
+void   journal_recovery_run(JournalRecovery* recovery);
@@ -0,0 +1,135 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+uint64_t profile_now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ProfileScope::ProfileScope(Profiler& profiler, size_t stage) : profiler(profiler), stage(stage), start(profile_now()) {
+}
+
+ProfileScope::~ProfileScope() {
+    if (!profiler.recording) return;
+
+    ProfileEvent event;
+    event.stage    = stage;
+    event.start    = start - profiler.epoch;
+    event.duration = profile_now() - start;
+    profiler.current.events.push_back(event);
+}
+
+void profiler_initialize(Profiler& profiler, const char* const* stages, size_t count) {
+    profiler.stages.assign(stages, stages + count);
+    profiler.frames.clear();
+    profiler.frames.reserve(PROFILE_FRAMES);
+    profiler.next      = 0;
+    profiler.recording = false;
+    profiler.epoch     = profile_now();
+    profiler.overlay   = false;
+    profiler.countAllocations = nullptr;
+}
+
+void profiler_begin_frame(Profiler& profiler) {
+    profiler.current.events.clear();
+    profiler.current.start       = profile_now() - profiler.epoch;
+    profiler.current.allocations = profiler.countAllocations ? profiler.countAllocations() : 0;
+    profiler.recording           = true;
+}
+
+void profiler_end_frame(Profiler& profiler) {
+    if (!profiler.recording) return;
+
+    profiler.current.duration    = profile_now() - profiler.epoch - profiler.current.start;
+    profiler.current.allocations = profiler.countAllocations ? profiler.countAllocations() - profiler.current.allocations : 0;
+    profiler.recording           = false;
+
+    if (profiler.frames.size() < PROFILE_FRAMES) {
+        profiler.frames.push_back(ProfileFrame());
+    }
+    std::swap(profiler.current, profiler.frames[profiler.next]);
+    profiler.next = (profiler.next + 1) % PROFILE_FRAMES;
+}
+
+const ProfileFrame* profiler_last_frame(const Profiler& profiler) {
+    if (profiler.frames.empty()) return nullptr;
+    return &profiler.frames[(profiler.next + profiler.frames.size() - 1) % profiler.frames.size()];
+}
+
+uint64_t profile_frame_stage(const ProfileFrame& frame, size_t stage) {
+    uint64_t total = 0;
+    for (const ProfileEvent& event : frame.events) {
+        if (event.stage == stage) total += event.duration;
+    }
+    return total;
+}
+
+uint64_t profiler_stage_last(const Profiler& profiler, size_t stage) {
+    const ProfileFrame* frame = profiler_last_frame(profiler);
+    return frame ? profile_frame_stage(*frame, stage) : 0;
+}
+
+uint64_t profile_percentile(Vector<uint64_t>& values, double p) {
+    if (values.empty()) return 0;
+    Vector<uint64_t>::iterator nth = values.begin() + (size_t)(p * (values.size() - 1));
+    std::nth_element(values.begin(), nth, values.end());
+    return *nth;
+}
+
+uint64_t profiler_stage_percentile(const Profiler& profiler, size_t stage, double p) {
+    profiler.scratch.clear();
+    for (const ProfileFrame& frame : profiler.frames) {
+        profiler.scratch.push_back(profile_frame_stage(frame, stage));
+    }
+    return profile_percentile(profiler.scratch, p);
+}
+
+uint64_t profiler_frame_percentile(const Profiler& profiler, double p) {
+    profiler.scratch.clear();
+    for (const ProfileFrame& frame : profiler.frames) {
+        profiler.scratch.push_back(frame.duration);
+    }
+    return profile_percentile(profiler.scratch, p);
+}
+
+// Chrome trace-event format ("X" complete events, microseconds), readable by
+// chrome://tracing and Perfetto. Each frame is one event with its stages nested inside.
+bool profiler_write_trace(const Profiler& profiler, const String& path, String& error) {
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        error = strerror(errno);
+        return false;
+    }
+
+    size_t count  = profiler.frames.size();
+    size_t oldest = count < PROFILE_FRAMES ? 0 : profiler.next;
+    bool   first  = true;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (size_t idx = 0; idx < count; idx++) {
+        const ProfileFrame& frame = profiler.frames[(oldest + idx) % count];
+        fprintf(file, "%s{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"allocations\":%zu}}",
+                first ? "" : ",\n", frame.start / 1e3, frame.duration / 1e3, frame.allocations);
+        first = false;
+
+        for (const ProfileEvent& event : frame.events) {
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+                    profiler.stages[event.stage], event.start / 1e3, event.duration / 1e3);
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    // The file is closed whether or not a write failed; the first error is the one reported.
+    bool writeFailed = ferror(file) != 0;
+    int  writeError  = errno;
+    if (fclose(file) != 0 || writeFailed) {
+        error = strerror(writeFailed ? writeError : errno);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "types.hpp"
+
+#include <cstdint>
+
+const size_t PROFILE_FRAMES = 600;
+
+struct ProfileEvent {
+    size_t               stage;
+    uint64_t             start;
+    uint64_t             duration;
+};
+
+struct ProfileFrame {
+    uint64_t             start;
+    uint64_t             duration;
+    size_t               allocations;
+    Vector<ProfileEvent> events;
+};
+
+// Number of allocations made so far by the thread that records frames.
+typedef size_t (*AllocationCounter)();
+
+// Keeps the last PROFILE_FRAMES frames in a ring. A finished frame is swapped into its
+// slot, so once the ring is full recording a frame does not allocate. Times are
+// nanoseconds since `epoch`. Allocations are only counted when the frontend supplies
+// `countAllocations`.
+struct Profiler {
+    Vector<const char*>  stages;
+    Vector<ProfileFrame> frames;
+    size_t               next;
+    ProfileFrame         current;
+    bool                 recording;
+    uint64_t             epoch;
+    bool                 overlay;
+    AllocationCounter    countAllocations;
+    mutable Vector<uint64_t> scratch;
+};
+
+// Times the enclosing block as one stage of the current frame.
+struct ProfileScope {
+    Profiler&            profiler;
+    size_t               stage;
+    uint64_t             start;
+
+    ProfileScope(Profiler& profiler, size_t stage);
+    ~ProfileScope();
+};
+
+uint64_t profile_now();
+
+void     profiler_initialize(Profiler& profiler, const char* const* stages, size_t count);
+void     profiler_begin_frame(Profiler& profiler);
+void     profiler_end_frame(Profiler& profiler);
+const ProfileFrame* profiler_last_frame(const Profiler& profiler);
+uint64_t profiler_stage_last(const Profiler& profiler, size_t stage);
+uint64_t profiler_stage_percentile(const Profiler& profiler, size_t stage, double p);
+uint64_t profiler_frame_percentile(const Profiler& profiler, double p);
+bool     profiler_write_trace(const Profiler& profiler, const String& path, String& error);
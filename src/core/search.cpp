@@ -0,0 +1,139 @@
+#include "search.hpp"
+
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Every kernel returns the position of the first occurrence of `needle`, or `size`.
+// Scalar fallback: memchr finds candidates for the first byte, memcmp confirms them.
+size_t search_find_scalar(const char* haystack, size_t size, const char* needle, size_t length) {
+    if (length == 0 || length > size) return size;
+
+    const char* end = haystack + size - length + 1;
+    for (const char* at = haystack; at < end; at++) {
+        at = (const char*)memchr(at, needle[0], end - at);
+        if (at == nullptr) break;
+        if (memcmp(at, needle, length) == 0) return at - haystack;
+    }
+    return size;
+}
+
+size_t search_find_tail(const char* haystack, size_t size, size_t from, const char* needle, size_t length) {
+    size_t found = search_find_scalar(haystack + from, size - from, needle, length);
+    return found == size - from ? size : from + found;
+}
+
+#if defined(__SSE2__)
+// Compares the first and the last byte of the needle against 16 positions at once and
+// only runs memcmp where both agree.
+size_t search_find_sse2(const char* haystack, size_t size, const char* needle, size_t length) {
+    if (length == 0 || length > size) return size;
+
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last  = _mm_set1_epi8(needle[length - 1]);
+
+    size_t idx = 0;
+    for (; idx + length - 1 + 16 <= size; idx += 16) {
+        __m128i blockFirst = _mm_loadu_si128((const __m128i*)(haystack + idx));
+        __m128i blockLast  = _mm_loadu_si128((const __m128i*)(haystack + idx + length - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(blockFirst, first), _mm_cmpeq_epi8(blockLast, last)));
+        for (; mask != 0; mask &= mask - 1) {
+            size_t at = idx + __builtin_ctz(mask);
+            if (memcmp(haystack + at, needle, length) == 0) return at;
+        }
+    }
+    return search_find_tail(haystack, size, idx, needle, length);
+}
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SEARCH_HAS_AVX2 1
+// Same filter as search_find_sse2 over 32 positions; only selected when the CPU has AVX2.
+__attribute__((target("avx2")))
+size_t search_find_avx2(const char* haystack, size_t size, const char* needle, size_t length) {
+    if (length == 0 || length > size) return size;
+
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last  = _mm256_set1_epi8(needle[length - 1]);
+
+    size_t idx = 0;
+    for (; idx + length - 1 + 32 <= size; idx += 32) {
+        __m256i blockFirst = _mm256_loadu_si256((const __m256i*)(haystack + idx));
+        __m256i blockLast  = _mm256_loadu_si256((const __m256i*)(haystack + idx + length - 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first), _mm256_cmpeq_epi8(blockLast, last)));
+        for (; mask != 0; mask &= mask - 1) {
+            size_t at = idx + __builtin_ctz(mask);
+            if (memcmp(haystack + at, needle, length) == 0) return at;
+        }
+    }
+    return search_find_tail(haystack, size, idx, needle, length);
+}
+#endif
+
+SearchKernel search_select_kernel() {
+#if defined(SEARCH_HAS_AVX2)
+    if (__builtin_cpu_supports("avx2")) return &search_find_avx2;
+#endif
+#if defined(__SSE2__)
+    return &search_find_sse2;
+#else
+    return &search_find_scalar;
+#endif
+}
+
+size_t search_find(const char* haystack, size_t size, const char* needle, size_t length) {
+    static const SearchKernel kernel = search_select_kernel();
+    return kernel(haystack, size, needle, length);
+}
+
+// Appends the offsets (from `base`) of every match in `data` that starts before `startLimit`.
+void search_block(const char* data, size_t size, const String& pattern, size_t base, size_t startLimit, Vector<size_t>& matches) {
+    for (size_t at = 0; at < size && matches.size() < SEARCH_MAX_MATCHES; at++) {
+        size_t found = search_find(data + at, size - at, pattern.data(), pattern.size());
+        if (found == size - at) break;
+
+        at += found;
+        if (at >= startLimit) break;
+        matches.push_back(base + at);
+    }
+}
+
+// Finds every occurrence of `pattern` in the document made of `pieces`. Matches may
+// straddle pieces, so `carry` keeps the last pattern.size() - 1 bytes seen so far.
+void search_pieces(const Vector<Piece>& pieces, const char* original, const char* add, const String& pattern, const std::atomic<bool>& cancelled, Vector<size_t>& matches) {
+    if (pattern.empty()) return;
+
+    size_t overlap = pattern.size() - 1;
+    size_t offset  = 0;
+    String carry;
+
+    for (size_t idx = 0; idx < pieces.size() && !cancelled; idx++) {
+        const Piece& piece = pieces[idx];
+        const char*  data  = (piece.source == PieceSource::ORIGINAL ? original : add) + piece.start;
+
+        if (!carry.empty()) {
+            String stitched = carry;
+            stitched.append(data, std::min(piece.length, overlap));
+            search_block(stitched.data(), stitched.size(), pattern, offset - carry.size(), carry.size(), matches);
+        }
+
+        for (size_t block = 0; block < piece.length && !cancelled; block += SEARCH_BLOCK) {
+            size_t end = std::min(piece.length, block + SEARCH_BLOCK + overlap);
+            search_block(data + block, end - block, pattern, offset + block, SEARCH_BLOCK, matches);
+        }
+
+        if (piece.length >= overlap) {
+            carry.assign(data + piece.length - overlap, overlap);
+        } else {
+            carry.append(data, piece.length);
+            carry.erase(0, carry.size() - std::min(carry.size(), overlap));
+        }
+        offset += piece.length;
+    }
+}
+
+void search_job_run(SearchJob* job) {
+    search_pieces(job->snapshot.pieces, job->snapshot.original, job->snapshot.add, job->pattern, job->cancelled, job->matches);
+    job->finished = true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "text_engine.hpp"
+
+#include <thread>
+#include <atomic>
+#include <memory>
+
+typedef size_t (*SearchKernel)(const char* haystack, size_t size, const char* needle, size_t length);
+
+const size_t SEARCH_BLOCK       = 4 << 20;
+const size_t SEARCH_SYNC_LIMIT  = 1 << 20;
+const size_t SEARCH_MAX_MATCHES = 1 << 22;
+
+// Searches a TextSnapshot on a worker thread; `cancelled` is checked between blocks.
+struct SearchJob {
+    std::thread          worker;
+    std::atomic<bool>    cancelled;
+    std::atomic<bool>    finished;
+    TextSnapshot         snapshot;
+    String               pattern;
+    size_t               version;
+    Vector<size_t>       matches;
+};
+
+// `matches` are sorted document offsets and only valid while `version` equals the
+// text version; buffer_poll_search starts a new search when they fall behind.
+struct Search {
+    String               pattern;
+    Vector<size_t>       matches;
+    size_t               version;
+    size_t               origin;
+    bool                 jumpPending;
+    std::unique_ptr<SearchJob> job;
+};
+
+size_t search_find(const char* haystack, size_t size, const char* needle, size_t length);
+void   search_pieces(const Vector<Piece>& pieces, const char* original, const char* add, const String& pattern, const std::atomic<bool>& cancelled, Vector<size_t>& matches);
+void   search_job_run(SearchJob* job);
@@ -0,0 +1,303 @@
+#include "text_engine.hpp"
+
+#include <atomic>
+#include <cstring>
+
+const char* text_source_data(const TextEngine& text, PieceSource source) {
+    return source == PieceSource::ORIGINAL ? text.original : text.add->data();
+}
+
+const Vector<size_t>& text_source_newlines(const TextEngine& text, PieceSource source) {
+    return source == PieceSource::ORIGINAL ? text.originalNewlines : text.addNewlines;
+}
+
+size_t text_count_newlines(const TextEngine& text, PieceSource source, size_t start, size_t length) {
+    const Vector<size_t>& newlines = text_source_newlines(text, source);
+    return std::lower_bound(newlines.begin(), newlines.end(), start + length)
+         - std::lower_bound(newlines.begin(), newlines.end(), start);
+}
+
+// Recomputes the prefix sums of every piece from `from` onwards.
+void text_rebuild_index(TextEngine& text, size_t from) {
+    text.pieceOffsets.resize(text.pieces.size());
+    text.pieceLines.resize(text.pieces.size());
+
+    size_t offset = 0;
+    size_t lines  = 0;
+    if (from > 0) {
+        offset = text.pieceOffsets[from - 1] + text.pieces[from - 1].length;
+        lines  = text.pieceLines[from - 1] + text.pieces[from - 1].newlines;
+    }
+
+    for (size_t idx = from; idx < text.pieces.size(); idx++) {
+        text.pieceOffsets[idx] = offset;
+        text.pieceLines[idx]   = lines;
+        offset += text.pieces[idx].length;
+        lines  += text.pieces[idx].newlines;
+    }
+
+    text.size      = offset;
+    text.lineCount = lines + 1;
+}
+
+void text_initialize(TextEngine& text) {
+    text.original     = nullptr;
+    text.originalSize    = 0;
+    text.originalIndexed = 0;
+    text.originalNewlines.clear();
+    // A snapshot may still share the old add buffer, so it is replaced, never cleared.
+    text.add = std::make_shared<String>();
+    text.addNewlines.clear();
+    text.pieces.clear();
+    text.version = 0;
+    text_rebuild_index(text, 0);
+}
+
+void text_clear(TextEngine& text) {
+    size_t version = text.version;
+    text = TextEngine();
+    text_initialize(text);
+    text.version = version + 1;
+}
+
+// Resets `text` to a single piece spanning `data`. The newline index starts empty and
+// is filled in with `text_index_original`.
+void text_load_original(TextEngine& text, const char* data, size_t size) {
+    text_clear(text);
+    text.original     = data;
+    text.originalSize = size;
+
+    // save() always terminates the last line, so a trailing newline is not part of the document.
+    size_t length = (size > 0 && data[size - 1] == '\n') ? size - 1 : size;
+    if (length > 0) {
+        Piece piece;
+        piece.source   = PieceSource::ORIGINAL;
+        piece.start    = 0;
+        piece.length   = length;
+        piece.newlines = 0;
+        text.pieces.push_back(piece);
+    }
+    text_rebuild_index(text, 0);
+}
+
+// Resets `text` to a single add buffer piece holding `data`, which is taken over rather
+// than copied.
+void text_adopt(TextEngine& text, String& data) {
+    text_clear(text);
+    text.add->swap(data);
+
+    const char* begin = text.add->data();
+    const char* end   = begin + text.add->size();
+    for (const char* nl = begin; (nl = (const char*)memchr(nl, '\n', end - nl)) != nullptr; nl++) {
+        text.addNewlines.push_back(nl - begin);
+    }
+    if (!text.add->empty()) {
+        Piece piece;
+        piece.source   = PieceSource::ADD;
+        piece.start    = 0;
+        piece.length   = text.add->size();
+        piece.newlines = text.addNewlines.size();
+        text.pieces.push_back(piece);
+    }
+    text_rebuild_index(text, 0);
+}
+
+// Appends newline offsets found in `original` up to `indexed` and refreshes the line counts.
+void text_index_original(TextEngine& text, const Vector<size_t>& newlines, size_t indexed) {
+    text.originalNewlines.insert(text.originalNewlines.end(), newlines.begin(), newlines.end());
+    text.originalIndexed = indexed;
+
+    for (Piece& piece : text.pieces) {
+        if (piece.source == PieceSource::ORIGINAL) {
+            piece.newlines = text_count_newlines(text, piece.source, piece.start, piece.length);
+        }
+    }
+    text_rebuild_index(text, 0);
+}
+
+// Appends the offset of every newline in the document, in order. The original newline
+// index has to cover every original piece.
+void text_collect_newlines(const TextEngine& text, Vector<size_t>& newlines) {
+    for (size_t idx = 0; idx < text.pieces.size(); idx++) {
+        const Piece&          piece  = text.pieces[idx];
+        const Vector<size_t>& source = text_source_newlines(text, piece.source);
+        Vector<size_t>::const_iterator first = std::lower_bound(source.begin(), source.end(), piece.start);
+        Vector<size_t>::const_iterator last  = std::lower_bound(first, source.end(), piece.start + piece.length);
+        for (; first != last; ++first) {
+            newlines.push_back(text.pieceOffsets[idx] + *first - piece.start);
+        }
+    }
+}
+
+// Index of the piece containing `offset`, or `pieces.size()` when `offset` is the end.
+size_t text_find_piece(const TextEngine& text, size_t offset) {
+    if (offset >= text.size) return text.pieces.size();
+    return std::upper_bound(text.pieceOffsets.begin(), text.pieceOffsets.end(), offset) - text.pieceOffsets.begin() - 1;
+}
+
+// Makes sure a piece starts exactly at `offset` and returns its index.
+size_t text_split(TextEngine& text, size_t offset) {
+    size_t idx = text_find_piece(text, offset);
+    if (idx == text.pieces.size() || text.pieceOffsets[idx] == offset) return idx;
+
+    Piece& piece = text.pieces[idx];
+    size_t head  = offset - text.pieceOffsets[idx];
+
+    Piece tail;
+    tail.source   = piece.source;
+    tail.start    = piece.start + head;
+    tail.length   = piece.length - head;
+    tail.newlines = text_count_newlines(text, tail.source, tail.start, tail.length);
+
+    piece.length    = head;
+    piece.newlines -= tail.newlines;
+
+    text.pieces.insert(text.pieces.begin() + idx + 1, tail);
+    text_rebuild_index(text, idx);
+    return idx + 1;
+}
+
+// Appends to the add buffer without touching bytes a snapshot may be reading. Within the
+// capacity nothing moves; a buffer that is shared and full is copied into a larger one,
+// and the snapshots keep the old one, so an edit costs a copy only every so often.
+void text_append(TextEngine& text, const char* data, size_t length) {
+    String& add = *text.add;
+    if (add.size() + length > add.capacity()) {
+        if (text.add.use_count() > 1) {
+            std::shared_ptr<String> grown = std::make_shared<String>();
+            grown->reserve(std::max(add.size() + length, add.capacity() + add.capacity() / 2));
+            grown->append(add);
+            text.add = grown;
+        } else {
+            // The last snapshot is gone; its reads happen before the buffer moves.
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+    }
+    text.add->append(data, length);
+}
+
+void text_insert(TextEngine& text, size_t offset, const char* data, size_t length) {
+    if (length == 0) return;
+    offset = std::min(offset, text.size);
+    text.version++;
+
+    size_t addStart     = text.add->size();
+    size_t newlinesFrom = text.addNewlines.size();
+    text_append(text, data, length);
+
+    const char* begin = text.add->data() + addStart;
+    const char* end   = begin + length;
+    for (const char* nl = begin; (nl = (const char*)memchr(nl, '\n', end - nl)) != nullptr; nl++) {
+        text.addNewlines.push_back(nl - text.add->data());
+    }
+    size_t newlines = text.addNewlines.size() - newlinesFrom;
+
+    // Typing appends to the add buffer right behind the previous insertion, so the
+    // piece that ends at `offset` can simply grow instead of splitting the table.
+    if (offset > 0) {
+        size_t prev  = text_find_piece(text, offset - 1);
+        Piece& piece = text.pieces[prev];
+        if (piece.source == PieceSource::ADD
+            && text.pieceOffsets[prev] + piece.length == offset
+            && piece.start + piece.length == addStart) {
+            piece.length   += length;
+            piece.newlines += newlines;
+            text_rebuild_index(text, prev);
+            return;
+        }
+    }
+
+    Piece piece;
+    piece.source   = PieceSource::ADD;
+    piece.start    = addStart;
+    piece.length   = length;
+    piece.newlines = newlines;
+
+    size_t idx = text_split(text, offset);
+    text.pieces.insert(text.pieces.begin() + idx, piece);
+    text_rebuild_index(text, idx);
+}
+
+// Removes [offset, offset + length) and appends the pieces that held it to `removed`.
+// Both sources are never rewritten, so those pieces stay valid for text_insert_pieces.
+void text_remove(TextEngine& text, size_t offset, size_t length, Vector<Piece>& removed) {
+    if (length == 0 || offset >= text.size) return;
+    length = std::min(length, text.size - offset);
+    text.version++;
+
+    size_t first = text_split(text, offset);
+    size_t last  = text_split(text, offset + length);
+    removed.insert(removed.end(), text.pieces.begin() + first, text.pieces.begin() + last);
+    text.pieces.erase(text.pieces.begin() + first, text.pieces.begin() + last);
+    text_rebuild_index(text, first);
+}
+
+void text_erase(TextEngine& text, size_t offset, size_t length) {
+    Vector<Piece> removed;
+    text_remove(text, offset, length, removed);
+}
+
+// Splices previously removed pieces back in at `offset` without copying any text.
+void text_insert_pieces(TextEngine& text, size_t offset, const Vector<Piece>& pieces) {
+    if (pieces.empty()) return;
+    offset = std::min(offset, text.size);
+    text.version++;
+
+    size_t idx = text_split(text, offset);
+    text.pieces.insert(text.pieces.begin() + idx, pieces.begin(), pieces.end());
+    for (size_t inserted = idx; inserted < idx + pieces.size(); inserted++) {
+        Piece& piece = text.pieces[inserted];
+        piece.newlines = text_count_newlines(text, piece.source, piece.start, piece.length);
+    }
+    text_rebuild_index(text, idx);
+}
+
+size_t text_line_start(const TextEngine& text, size_t line) {
+    if (line == 0) return 0;
+    if (line >= text.lineCount) return text.size;
+
+    size_t idx = std::lower_bound(text.pieceLines.begin(), text.pieceLines.end(), line) - text.pieceLines.begin() - 1;
+    const Piece&          piece    = text.pieces[idx];
+    const Vector<size_t>& newlines = text_source_newlines(text, piece.source);
+
+    size_t first = std::lower_bound(newlines.begin(), newlines.end(), piece.start) - newlines.begin();
+    size_t nl    = newlines[first + (line - text.pieceLines[idx]) - 1];
+    return text.pieceOffsets[idx] + (nl - piece.start) + 1;
+}
+
+size_t text_line_of(const TextEngine& text, size_t offset) {
+    size_t idx = text_find_piece(text, offset);
+    if (idx == text.pieces.size()) return text.lineCount - 1;
+
+    const Piece& piece = text.pieces[idx];
+    return text.pieceLines[idx] + text_count_newlines(text, piece.source, piece.start, offset - text.pieceOffsets[idx]);
+}
+
+// Offset of the end of `line`, not counting its trailing newline.
+size_t text_line_end(const TextEngine& text, size_t line) {
+    return line + 1 < text.lineCount ? text_line_start(text, line + 1) - 1 : text.size;
+}
+
+size_t text_line_length(const TextEngine& text, size_t line) {
+    return text_line_end(text, line) - text_line_start(text, line);
+}
+
+char text_char_at(const TextEngine& text, size_t offset) {
+    size_t idx = text_find_piece(text, offset);
+    if (idx == text.pieces.size()) return '\0';
+
+    const Piece& piece = text.pieces[idx];
+    return text_source_data(text, piece.source)[piece.start + offset - text.pieceOffsets[idx]];
+}
+
+void text_snapshot(const TextEngine& text, TextSnapshot& snapshot) {
+    snapshot.original = text.original;
+    snapshot.addOwner = text.add;
+    snapshot.add      = text.add->data();
+    snapshot.pieces   = text.pieces;
+    snapshot.size     = text.size;
+}
+
+const char* text_snapshot_piece_data(const TextSnapshot& snapshot, const Piece& piece) {
+    return (piece.source == PieceSource::ORIGINAL ? snapshot.original : snapshot.add) + piece.start;
+}
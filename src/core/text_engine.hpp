@@ -0,0 +1,81 @@
+#pragma once
+
+#include "types.hpp"
+
+#include <algorithm>
+#include <memory>
+
+enum class PieceSource { ORIGINAL, ADD };
+
+struct Piece {
+    PieceSource          source;
+    size_t               start;
+    size_t               length;
+    size_t               newlines;
+};
+
+// Piece table text storage. The document is the concatenation of `pieces`, each one
+// a slice of either the read-only `original` text or the append-only `add` buffer.
+// Both sources keep a sorted index of their newline offsets, and the piece prefix
+// sums (`pieceOffsets`, `pieceLines`) turn offset and line lookups into binary searches.
+// The original newline index may still be growing (see `LineIndexer`); only the first
+// `originalIndexed` bytes of `original` are covered by it. Snapshots share `add`: bytes
+// once appended never change or move, see text_append.
+struct TextEngine {
+    const char*          original;
+    size_t               originalSize;
+    size_t               originalIndexed;
+    Vector<size_t>       originalNewlines;
+    std::shared_ptr<String> add;
+    Vector<size_t>       addNewlines;
+    Vector<Piece>        pieces;
+    Vector<size_t>       pieceOffsets;
+    Vector<size_t>       pieceLines;
+    size_t               size;
+    size_t               lineCount;
+    size_t               version;
+};
+
+// Immutable copy of a TextEngine's pieces for readers on other threads. The original
+// text is shared, so its mapping must outlive the snapshot; the add buffer is shared
+// too, and `addOwner` keeps the bytes `add` points to alive.
+struct TextSnapshot {
+    const char*          original;
+    std::shared_ptr<const String> addOwner;
+    const char*          add;
+    Vector<Piece>        pieces;
+    size_t               size;
+};
+
+void        text_initialize(TextEngine& text);
+void        text_clear(TextEngine& text);
+void        text_load_original(TextEngine& text, const char* data, size_t size);
+void        text_adopt(TextEngine& text, String& data);
+void        text_index_original(TextEngine& text, const Vector<size_t>& newlines, size_t indexed);
+void        text_collect_newlines(const TextEngine& text, Vector<size_t>& newlines);
+const char* text_source_data(const TextEngine& text, PieceSource source);
+size_t      text_find_piece(const TextEngine& text, size_t offset);
+void        text_insert(TextEngine& text, size_t offset, const char* data, size_t length);
+void        text_remove(TextEngine& text, size_t offset, size_t length, Vector<Piece>& removed);
+void        text_erase(TextEngine& text, size_t offset, size_t length);
+void        text_insert_pieces(TextEngine& text, size_t offset, const Vector<Piece>& pieces);
+size_t      text_line_start(const TextEngine& text, size_t line);
+size_t      text_line_of(const TextEngine& text, size_t offset);
+size_t      text_line_end(const TextEngine& text, size_t line);
+size_t      text_line_length(const TextEngine& text, size_t line);
+char        text_char_at(const TextEngine& text, size_t offset);
+void        text_snapshot(const TextEngine& text, TextSnapshot& snapshot);
+const char* text_snapshot_piece_data(const TextSnapshot& snapshot, const Piece& piece);
+
+// Calls `fn(const char* data, size_t length)` for every contiguous run of text in [begin, end).
+template <typename Fn>
+void text_for_each_chunk(const TextEngine& text, size_t begin, size_t end, Fn fn) {
+    end = std::min(end, text.size);
+    for (size_t idx = text_find_piece(text, begin); begin < end && idx < text.pieces.size(); idx++) {
+        const Piece& piece = text.pieces[idx];
+        size_t skip  = begin - text.pieceOffsets[idx];
+        size_t count = std::min(piece.length - skip, end - begin);
+        fn(text_source_data(text, piece.source) + piece.start + skip, count);
+        begin += count;
+    }
+}
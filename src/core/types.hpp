@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+using String = std::string;
+
+template <typename T> 
+using Vector = std::vector<T>;
+
+template <typename K, typename V>
+using HashMap = std::unordered_map<K, V>;
+
+// A column (x) on a line (y) of a document.
+struct Position {
+    size_t               x;
+    size_t               y;
+};
@@ -1,44 +1,12 @@
 #include "../vendor/raylib/include/raylib.h"
+#include "core/editor.hpp"
+#include "render/glyph_renderer.hpp"
 
 #include <cstdlib>
-#include <string>
-#include <vector>
-#include <algorithm>
-#include <fstream>
-
-using String = std::string;
-
-template <typename T> 
-using Vector = std::vector<T>;
-
-struct Word {
-    String               content;
-    Vector2              pos;
-};
-
-enum class Mode { NORMAL, INSERT, SELECT, COMMAND };
-
-struct Buffer {
-    int                  leftMargin;
-    Vector2              pos;
-    Vector<Vector<Word>> lines;
-    Vector2              cursor;
-    Mode                 mode;
-    int                  spacing;
-    float                fontSize;
-    const char*          name;
-    char                 lastCharPressed;
-};
-
-struct ModalProps {
-    int                  width; 
-    int                  height;
-    int                  posX; 
-    int                  posY;
-    int                  contentMarginX; 
-    int                  contentMarginY;
-    const char*          content;
-};
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <new>
 
 // @TODO: ADD MINIBUFFER
 // The system should have a mini buffer
@@ -52,28 +20,15 @@ struct MiniBuffer {
 
     Vector2              cursor;
     String               content;
+    String               message;
     Vector2              pos;
     float                fontSize;
     LineBar              lineBar;
 };
 
-void draw_modal(const ModalProps& modalProps) {
-    DrawRectangle(modalProps.posX, modalProps.posY, modalProps.width, modalProps.height, DARKGRAY);
-    DrawRectangleLines(modalProps.posX, modalProps.posY, modalProps.width, modalProps.height, RAYWHITE);
-    DrawText(modalProps.content, modalProps.posX + modalProps.contentMarginX, modalProps.posY + modalProps.contentMarginY, 14, RED);
-}
-
-void buffer_initialize(Buffer& buffer) {
-    buffer.leftMargin = 10;
-    buffer.cursor     = {0, 0};
-    buffer.mode       = Mode::NORMAL;
-    buffer.spacing    = 7;
-    buffer.fontSize   = 20;
-    buffer.lines.push_back(Vector<Word>());
-}
-
 void mini_buffer_initialize(MiniBuffer& minibuffer) {
     minibuffer.content           = "";
+    minibuffer.message           = "";
     minibuffer.lineBar.spacing   = 7;
     minibuffer.fontSize          = 20;
     minibuffer.lineBar.fontColor = RAYWHITE;
@@ -86,8 +41,37 @@ float buffer_cursor_measure_text(const MiniBuffer& minibuffer) {
     return MeasureText(minibuffer.content.c_str(), minibuffer.fontSize) + minibuffer.lineBar.spacing;
 }
 
-float buffer_cursor_measure_text(const Buffer& buffer, int idx) {
-    return MeasureText(buffer.lines[buffer.cursor.y][idx].content.c_str(), buffer.fontSize) + buffer.spacing;
+struct GlyphAdvanceTable {
+    unsigned int         fontId;
+    int                  fontSize;
+    float                advances[256];
+};
+
+// MeasureText of a single byte, measured once per (font, size, byte) and reused afterwards.
+float glyph_advance(int fontSize, char c) {
+    static Vector<GlyphAdvanceTable> tables;
+    static size_t                    last = 0;
+
+    unsigned int fontId = GetFontDefault().texture.id;
+    if (last < tables.size() && tables[last].fontId == fontId && tables[last].fontSize == fontSize) {
+        return tables[last].advances[(unsigned char)c];
+    }
+
+    for (last = 0; last < tables.size(); last++) {
+        if (tables[last].fontId == fontId && tables[last].fontSize == fontSize) {
+            return tables[last].advances[(unsigned char)c];
+        }
+    }
+
+    GlyphAdvanceTable table;
+    table.fontId   = fontId;
+    table.fontSize = fontSize;
+    for (int code = 0; code < 256; code++) {
+        char glyph[2] = { (char)code, '\0' };
+        table.advances[code] = MeasureText(glyph, fontSize);
+    }
+    tables.push_back(table);
+    return table.advances[(unsigned char)c];
 }
 
 void mini_buffer_insert_char(char userInput, MiniBuffer& minibuffer) {
@@ -149,38 +133,10 @@ void mini_buffer_draw(MiniBuffer& minibuffer) {
     mini_buffer_draw_cursor(minibuffer);
 }
 
-bool buffer_is_insert_mode(const Buffer& buffer) {
-    return buffer.mode == Mode::INSERT;
-}
-
-bool buffer_is_normal_mode(const Buffer& buffer) {
-    return buffer.mode == Mode::NORMAL;
-}
-
-bool buffer_is_command_mode(const Buffer& buffer) {
-    return buffer.mode == Mode::COMMAND;
-}
-
-void buffer_enable_insert_mode(Buffer& buffer) {
-    if (buffer_is_normal_mode(buffer)) {
-        buffer.mode = Mode::INSERT;
-    }
-}
-
-void buffer_enable_normal_mode(Buffer& buffer) {
-    buffer.mode = Mode::NORMAL;
-}
-
-void buffer_enable_select_mode(Buffer& buffer) {
-    if (buffer_is_normal_mode(buffer)) {
-        buffer.mode = Mode::SELECT;
-    }
-}
-
-void buffer_enable_command_mode(Buffer& buffer) {
-    if (buffer_is_normal_mode(buffer)) {
-        buffer.mode = Mode::COMMAND;
-    }
+void mini_buffer_draw_message(MiniBuffer& minibuffer) {
+    if (minibuffer.message.empty()) return;
+    DrawRectangle(0, minibuffer.lineBar.pos.y, GetScreenWidth(), minibuffer.fontSize * 2, DARKGRAY);
+    DrawText(minibuffer.message.c_str(), minibuffer.lineBar.pos.x, minibuffer.lineBar.pos.y, minibuffer.fontSize, minibuffer.lineBar.fontColor);
 }
 
 void buffer_handle_mode(Buffer& buffer) {
@@ -189,75 +145,62 @@ void buffer_handle_mode(Buffer& buffer) {
     buffer_handle_event(KEY_ESCAPE, buffer, &IsKeyPressed, &buffer_enable_normal_mode);
 
     if (buffer_is_normal_mode(buffer)) {
-        buffer_handle_event((GetCharPressed() == KEY_COLON), buffer, &buffer_enable_command_mode);    
+        int key = GetCharPressed();
+        buffer_handle_event((key == KEY_COLON), buffer, &buffer_enable_command_mode);    
+        buffer_handle_event((key == KEY_SLASH), buffer, &buffer_enable_search_mode);
     }
 }
 
-void buffer_cursor_move_left(Buffer& buffer) {
-    if (buffer.cursor.x > 0) {
-        buffer.cursor.x--;
-    } else if (buffer.cursor.y > 0) {
-        buffer.cursor.y--;
-        buffer.cursor.x = buffer.lines[buffer.cursor.y].size();
-    }
+void buffer_cursor_move_to_mouse(Buffer& buffer) {
+    Vector2 mouse = GetMousePosition();
+    buffer_cursor_move_to_point(buffer, mouse.x, mouse.y);
 }
 
-void buffer_cursor_move_right(Buffer& buffer) {
-    if (buffer.cursor.x < buffer.lines[buffer.cursor.y].size()) {
-        buffer.cursor.x++;
-    } else if (buffer.cursor.y < buffer.lines.size() - 1) {
-        buffer.cursor.y++;
-        buffer.cursor.x = 0;
-    }
+void buffer_handle_cursor_movement(Buffer& buffer) {
+    buffer_handle_event(KEY_RIGHT, buffer, &IsKeyPressed, &buffer_cursor_move_right);
+    buffer_handle_event(KEY_LEFT,  buffer, &IsKeyPressed, &buffer_cursor_move_left);
+    buffer_handle_event(KEY_UP,    buffer, &IsKeyPressed, &buffer_cursor_move_up);
+    buffer_handle_event(KEY_DOWN,  buffer, &IsKeyPressed, &buffer_cursor_move_down);
+    buffer_handle_event(IsMouseButtonPressed(MOUSE_BUTTON_LEFT), buffer, &buffer_cursor_move_to_mouse);
 }
 
-void buffer_cursor_move_up(Buffer& buffer) {
-    if (buffer.cursor.y > 0) {
-        buffer.cursor.y--;
-        buffer.cursor.x = std::min((int)buffer.cursor.x, (int)buffer.lines[buffer.cursor.y].size());
-    }
+bool buffer_is_undo_pressed() {
+    return !IsKeyDown(KEY_LEFT_CONTROL) && !IsKeyDown(KEY_RIGHT_CONTROL) && IsKeyPressed(KEY_U);
 }
 
-void buffer_cursor_move_down(Buffer& buffer) {
-    if (buffer.cursor.y < buffer.lines.size() - 1) {
-        buffer.cursor.y++;
-        buffer.cursor.x = std::min((int)buffer.cursor.x, (int)buffer.lines[buffer.cursor.y].size());
-    }
+bool buffer_is_redo_pressed() {
+    return (IsKeyDown(KEY_LEFT_CONTROL) || IsKeyDown(KEY_RIGHT_CONTROL)) && IsKeyPressed(KEY_R);
 }
 
-void buffer_handle_cursor_movement(Buffer& buffer) {
-    buffer_handle_event(KEY_RIGHT, buffer, &IsKeyPressed, &buffer_cursor_move_right);
-    buffer_handle_event(KEY_LEFT,  buffer, &IsKeyPressed, &buffer_cursor_move_left);
-    buffer_handle_event(KEY_UP,    buffer, &IsKeyPressed, &buffer_cursor_move_up);
-    buffer_handle_event(KEY_DOWN,  buffer, &IsKeyPressed, &buffer_cursor_move_down);
+bool buffer_is_shift_down() {
+    return IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT);
 }
 
-void buffer_insert_char(Buffer& buffer, char c) {
-    Word word;
-    word.content = String(1, c);
-    word.pos     = {0, 0};
+void buffer_handle_search_navigation(Buffer& buffer) {
+    if (!buffer_is_normal_mode(buffer) || !IsKeyPressed(KEY_N)) return;
 
-    if (buffer.lines[buffer.cursor.y].empty()) {
-        buffer.lines[buffer.cursor.y].push_back(word);
-    } else {
-        buffer.lines[buffer.cursor.y].insert(buffer.lines[buffer.cursor.y].begin() + buffer.cursor.x, word);
-    }
-    buffer.cursor.x++;
+    buffer_handle_event(!buffer_is_shift_down(), buffer, &buffer_search_next);
+    buffer_handle_event(buffer_is_shift_down(),  buffer, &buffer_search_previous);
 }
 
-void buffer_add_new_line(Buffer& buffer) {
-    buffer.lines.insert(buffer.lines.begin() + buffer.cursor.y + 1, Vector<Word>());
-    buffer.cursor.y++;
-    buffer.cursor.x = 0;
+void buffer_handle_history(Buffer& buffer) {
+    if (!buffer_is_normal_mode(buffer)) return;
+
+    buffer_handle_event(buffer_is_undo_pressed(), buffer, &buffer_undo);
+    buffer_handle_event(buffer_is_redo_pressed(), buffer, &buffer_redo);
 }
 
-void buffer_delete_char(Buffer& buffer) {
-    if (buffer.cursor.x > 0) {
-        buffer.lines[buffer.cursor.y].erase(buffer.lines[buffer.cursor.y].begin() + buffer.cursor.x - 1);
-        buffer.cursor.x--;
+void buffer_paste_clipboard(Buffer& buffer) {
+    const char* clipboard = GetClipboardText();
+    if (clipboard != nullptr) {
+        buffer_insert_text(buffer, clipboard, strlen(clipboard));
     }
 }
 
+bool buffer_is_paste_pressed() {
+    return (IsKeyDown(KEY_LEFT_CONTROL) || IsKeyDown(KEY_RIGHT_CONTROL)) && IsKeyPressed(KEY_V);
+}
+
 void buffer_handle_text_input(Buffer& buffer) {
     if (!buffer_is_insert_mode(buffer)) return;
 
@@ -271,93 +214,444 @@ void buffer_handle_text_input(Buffer& buffer) {
 
     buffer_handle_event(KEY_ENTER,     buffer, &IsKeyPressed, &buffer_add_new_line);
     buffer_handle_event(KEY_BACKSPACE, buffer, &IsKeyPressed, &buffer_delete_char);
+    buffer_handle_event(buffer_is_paste_pressed(), buffer, &buffer_paste_clipboard);
 }
 
 void buffer_draw_cursor(const Buffer& buffer) {
-    float x_offset = buffer.leftMargin;
-    for (int idx = 0; idx < buffer.cursor.x; idx++) {
-        x_offset += buffer_cursor_measure_text(buffer, idx);
-    }
-    
-    float y_offset = buffer.leftMargin + buffer.cursor.y * buffer.fontSize;
+    float x_offset = buffer.leftMargin + buffer_cursor_x(buffer);
+    float y_offset = buffer.leftMargin + (buffer.cursor.y - buffer.scroll.y) * buffer.fontSize;
     DrawRectangleLines((int)x_offset, (int)y_offset, 2, (int)buffer.fontSize, GetColor(0x4388c1b3));
 }
 
-void buffer_draw(const Buffer& buffer) {
-    ClearBackground(GetColor(0x181818FF));
+void buffer_draw_search_matches(const Buffer& buffer, size_t line, size_t lineStart, size_t lineEnd, float y_offset) {
+    if (!buffer_search_is_current(buffer)) return;
 
-    for (size_t y = 0; y < buffer.lines.size(); y++) {
-        float x_offset = buffer.leftMargin;
-        float y_offset = 10 + y * buffer.fontSize;
+    const Vector<size_t>& matches = buffer.search.matches;
+    size_t length = buffer.search.pattern.size();
+    Vector<size_t>::const_iterator it = std::lower_bound(matches.begin(), matches.end(), lineStart);
+    if (it == matches.end() || *it >= lineEnd) return;
 
-        for (const Word& word : buffer.lines[y]) {
-            DrawText(word.content.c_str(), (int)x_offset, (int)y_offset, buffer.fontSize, RAYWHITE);
-            x_offset += MeasureText(word.content.c_str(), buffer.fontSize) + buffer.spacing;
-        }
-    }
+    // Glyphs are at least `spacing` wide, so nothing past visible columns can be on screen.
+    const Vector<float>& prefix = buffer_line_widths(buffer, line, buffer.scroll.x + buffer_visible_columns(buffer) + length);
+    size_t scrolled = std::min(buffer.scroll.x, prefix.size() - 1);
+    it = std::lower_bound(it, matches.end(), lineStart + (scrolled >= length ? scrolled - length + 1 : 0));
 
-    buffer_draw_cursor(buffer);
+    for (; it != matches.end() && *it < lineEnd; ++it) {
+        size_t begin = std::min(*it - lineStart, prefix.size() - 1);
+        size_t end   = std::min(begin + length, prefix.size() - 1);
+        float  x     = buffer.leftMargin + prefix[begin] - prefix[scrolled];
+        if (x > buffer.viewportWidth) break;
+        DrawRectangle((int)x, (int)y_offset, (int)(prefix[end] - prefix[begin]), (int)buffer.fontSize, GetColor(0x8a6d1fff));
+    }
 }
 
-void save_modal_error() {
-    int width = 120, height = 70;
-    ModalProps modalProps {
-        width, 
-        height,
-        (GetScreenWidth() / 2) - width,
-        (GetScreenHeight() / 2) - height,
-        30, 
-        40,
-        "Error saving file!"
-    };
+const size_t LINE_CACHE_SPARE = 8;
 
-    ClearBackground(BLACK);
-    draw_modal(modalProps);
+struct LineTexture {
+    RenderTexture2D      target;
+    size_t               line;
+    size_t               version;
+    size_t               scrollX;
+    uint32_t             spanHash;
+};
+
+// Rendered text of the visible lines of one buffer, one texture per line. A texture is
+// reused as long as its line keeps the same buffer_line_version, horizontal scroll and
+// highlight spans, so a frame without edits only composites textures.
+struct LineTextureCache {
+    GlyphAtlas           atlas;
+    Vector<LineTexture>  slots;
+    HashMap<size_t, size_t> lines;
+    const Buffer*        buffer;
+    size_t               clock;
+    int                  width;
+    int                  height;
+};
+
+void line_cache_initialize(LineTextureCache& cache) {
+    cache.buffer = nullptr;
+    cache.clock  = 0;
+    cache.width  = 0;
+    cache.height = 0;
 }
 
-void save(Buffer& buffer) {
-    buffer.name = "./first_file.txt";
-    std::ofstream outputFile(buffer.name);
+void line_cache_unload(LineTextureCache& cache) {
+    for (LineTexture& slot : cache.slots) {
+        UnloadRenderTexture(slot.target);
+    }
+    cache.slots.clear();
+    cache.lines.clear();
+    cache.buffer = nullptr;
+}
+
+// Keeps one texture per visible row plus a few spare, sized for the current window and
+// font, and forgets every line when another buffer is shown.
+void line_cache_prepare(LineTextureCache& cache, const Buffer& buffer, size_t rows) {
+    int width  = GetScreenWidth();
+    int height = (int)buffer.fontSize;
+    if (width != cache.width || height != cache.height || cache.slots.size() < rows + LINE_CACHE_SPARE) {
+        line_cache_unload(cache);
+        glyph_atlas_build(cache.atlas, GetFontDefault(), height);
+        cache.width  = width;
+        cache.height = height;
+        cache.slots.resize(rows + LINE_CACHE_SPARE);
+        for (LineTexture& slot : cache.slots) {
+            slot.target = LoadRenderTexture(width, height);
+        }
+    }
 
-    if (!outputFile.is_open()) {
-        return save_modal_error();
+    if (cache.buffer != &buffer) {
+        cache.buffer = &buffer;
+        cache.lines.clear();
+        for (LineTexture& slot : cache.slots) {
+            slot.line = SIZE_MAX;
+        }
     }
+}
 
-    for (const auto& line : buffer.lines) {
-        for (const auto& word : line) {
-            outputFile << word.content;
+// Any slot not showing a line of [firstLine, lastLine) may be reused; there are more
+// slots than rows, so one is always found.
+size_t line_cache_free_slot(LineTextureCache& cache, size_t firstLine, size_t lastLine) {
+    for (;; cache.clock++) {
+        size_t idx  = cache.clock % cache.slots.size();
+        size_t line = cache.slots[idx].line;
+        if (line == SIZE_MAX || line < firstLine || line >= lastLine) {
+            if (line != SIZE_MAX) cache.lines.erase(line);
+            cache.clock++;
+            return idx;
         }
-        outputFile << '\n';
     }
+}
 
-    outputFile.close();
+Color token_color(TokenKind kind) {
+    switch (kind) {
+        case TokenKind::KEYWORD:      return GetColor(0xcc7832ff);
+        case TokenKind::TYPE:         return GetColor(0x6897bbff);
+        case TokenKind::NUMBER:       return GetColor(0xb5cea8ff);
+        case TokenKind::STRING:       return GetColor(0x6a8759ff);
+        case TokenKind::COMMENT:      return GetColor(0x808080ff);
+        case TokenKind::PREPROCESSOR: return GetColor(0xbbb529ff);
+        default:                      return RAYWHITE;
+    }
 }
 
-void buffer_exit(Buffer& buffer) {
-    buffer.lines.clear();
-    EndDrawing();
-    CloseWindow();
-    exit (EXIT_SUCCESS);
+// Glyph i of the layout is column scroll.x + i; spans are sorted, so one pass colors the line.
+void line_cache_render(const LineTextureCache& cache, LineTexture& slot, const Buffer& buffer, size_t line) {
+    static Vector<PlacedGlyph> glyphs;
+    buffer_layout_line(buffer, line, glyphs);
+
+    size_t count;
+    const HighlightSpan* spans = highlight_line_spans(buffer.highlight, line, count);
+    size_t span = 0;
+
+    BeginTextureMode(slot.target);
+        ClearBackground(BLANK);
+        glyph_batch_begin(cache.atlas, RAYWHITE);
+        Color color = RAYWHITE;
+        for (size_t idx = 0; idx < glyphs.size(); idx++) {
+            size_t column = buffer.scroll.x + idx;
+            while (span < count && spans[span].column + spans[span].length <= column) span++;
+
+            Color next = span < count && spans[span].column <= column ? token_color(spans[span].kind) : RAYWHITE;
+            if (ColorToInt(next) != ColorToInt(color)) {
+                color = next;
+                glyph_batch_color(color);
+            }
+            glyph_batch_quad(cache.atlas, glyphs[idx].c, glyphs[idx].x, 0);
+        }
+        glyph_batch_end();
+    EndTextureMode();
+
+    slot.line     = line;
+    slot.version  = buffer_line_version(buffer, line);
+    slot.scrollX  = buffer.scroll.x;
+    slot.spanHash = highlight_line_hash(buffer.highlight, line);
+}
+
+const LineTexture& line_cache_get(LineTextureCache& cache, const Buffer& buffer, size_t line, size_t firstLine, size_t lastLine) {
+    HashMap<size_t, size_t>::iterator found = cache.lines.find(line);
+    if (found != cache.lines.end()) {
+        LineTexture& slot = cache.slots[found->second];
+        if (slot.version != buffer_line_version(buffer, line) || slot.scrollX != buffer.scroll.x
+            || slot.spanHash != highlight_line_hash(buffer.highlight, line)) {
+            line_cache_render(cache, slot, buffer, line);
+        }
+        return slot;
+    }
+
+    size_t idx = line_cache_free_slot(cache, firstLine, lastLine);
+    cache.lines[line] = idx;
+    line_cache_render(cache, cache.slots[idx], buffer, line);
+    return cache.slots[idx];
 }
 
-typedef void (MiniBufferCommandHandler)(Buffer& buffer);
+void buffer_draw(const Buffer& buffer, LineTextureCache& cache) {
+    ClearBackground(GetColor(0x181818FF));
 
-void mini_buffer_execute_command(Buffer& buffer, bool condition, MiniBufferCommandHandler handler) {
-    if (condition) handler(buffer);
+    size_t rows      = buffer_visible_lines(buffer);
+    size_t firstLine = buffer.scroll.y;
+    size_t lastLine  = std::min(buffer.text.lineCount, firstLine + rows);
+    line_cache_prepare(cache, buffer, rows);
+
+    for (size_t y = firstLine; y < lastLine; y++) {
+        float y_offset = 10 + (y - firstLine) * buffer.fontSize;
+        buffer_draw_search_matches(buffer, y, text_line_start(buffer.text, y), text_line_end(buffer.text, y), y_offset);
+
+        // Render textures are stored upside down, hence the negative source height.
+        const LineTexture& slot = line_cache_get(cache, buffer, y, firstLine, lastLine);
+        Rectangle source = { 0, 0, (float)cache.width, -(float)cache.height };
+        DrawTextureRec(slot.target.texture, source, { (float)buffer.leftMargin, y_offset }, WHITE);
+    }
+
+    buffer_draw_cursor(buffer);
 }
 
-void buffer_handle_command(Buffer& buffer, MiniBuffer& minibuffer) {
+void editor_handle_command(Editor& editor, MiniBuffer& minibuffer) {
+    Buffer& buffer = editor_current(editor);
     if (buffer_is_command_mode(buffer)) {
         mini_buffer_handle_input(minibuffer);
-        mini_buffer_draw(minibuffer);
-    
-        if (IsKeyPressed(KEY_ENTER) && !minibuffer.content.empty()) {
-            mini_buffer_execute_command(buffer, minibuffer.content == "w", &save);
-            mini_buffer_execute_command(buffer, minibuffer.content == "q", &buffer_exit);
 
+        if (IsKeyPressed(KEY_ESCAPE)) {
             minibuffer.content.clear();
             buffer.mode = Mode::NORMAL;
+            return;
+        }
+    
+        if (IsKeyPressed(KEY_ENTER) && !minibuffer.content.empty()) {
+            // Commands may switch buffers, the one that ran them goes back to normal mode.
+            buffer.mode = Mode::NORMAL;
+            editor_execute_command(editor, minibuffer.content, minibuffer.message);
+            minibuffer.content.clear();
+        }
+    }
+}
+
+void mini_buffer_reset_cursor(MiniBuffer& minibuffer) {
+    minibuffer.cursor.x = buffer_cursor_measure_text(minibuffer);
+}
+
+// The mini buffer holds "/pattern" and the search is rerun whenever the pattern changes,
+// jumping to the first match from where the search started. Escape or deleting the
+// slash gives up and returns to that position.
+void buffer_handle_search(Buffer& buffer, MiniBuffer& minibuffer) {
+    if (!buffer_is_search_mode(buffer)) {
+        buffer_handle_search_navigation(buffer);
+        return;
+    }
+
+    if (minibuffer.content.empty()) {
+        buffer.search.origin = buffer_cursor_offset(buffer);
+        minibuffer.content   = "/";
+        minibuffer.message.clear();
+        mini_buffer_reset_cursor(minibuffer);
+    }
+    mini_buffer_handle_input(minibuffer);
+
+    if (IsKeyPressed(KEY_ESCAPE) || minibuffer.content.empty()) {
+        buffer_search_clear(buffer);
+        buffer_move_cursor_to_offset(buffer, buffer.search.origin);
+        minibuffer.content.clear();
+        buffer.mode = Mode::NORMAL;
+        return;
+    }
+
+    String pattern = minibuffer.content.substr(1);
+    if (pattern != buffer.search.pattern) {
+        buffer.search.pattern     = pattern;
+        buffer.search.jumpPending = true;
+        buffer_search_run(buffer);
+    }
+
+    if (IsKeyPressed(KEY_ENTER)) {
+        minibuffer.content.clear();
+        buffer.mode = Mode::NORMAL;
+    }
+}
+
+// Drawn after the buffer so ClearBackground does not wipe it.
+void buffer_draw_mini_buffer(const Buffer& buffer, MiniBuffer& minibuffer) {
+    if (buffer_is_command_mode(buffer) || buffer_is_search_mode(buffer)) {
+        mini_buffer_draw(minibuffer);
+    } else {
+        mini_buffer_draw_message(minibuffer);
+    }
+}
+
+const int EXPLORER_WIDTH     = 320;
+const int EXPLORER_FONT_SIZE = 14;
+
+bool explorer_is_printable_char(int key) {
+    return key >= 32 && key <= 126;
+}
+
+// While the pane has focus it takes the keyboard: typing filters by file name, Up/Down
+// select, Enter opens a file or folds a directory, Escape clears the filter, then leaves.
+void explorer_handle_input(Editor& editor, String& message) {
+    Explorer& explorer = editor.explorer;
+    if (!explorer.focused) return;
+
+    String query = explorer.query;
+    for (int key = GetCharPressed(); key > 0; key = GetCharPressed()) {
+        if (explorer_is_printable_char(key)) query.push_back((char)key);
+    }
+    if (IsKeyPressed(KEY_BACKSPACE) && !query.empty()) query.pop_back();
+    if (query != explorer.query) explorer_set_query(explorer, query);
+
+    if (IsKeyPressed(KEY_UP))   explorer_select(explorer, -1);
+    if (IsKeyPressed(KEY_DOWN)) explorer_select(explorer, 1);
+
+    String path;
+    if (IsKeyPressed(KEY_ENTER) && explorer_activate(explorer, path)) {
+        editor_open_file(editor, message, path);
+        explorer.focused = false;
+    }
+    if (IsKeyPressed(KEY_ESCAPE)) {
+        if (explorer.query.empty()) explorer.focused = false; else explorer_set_query(explorer, "");
+    }
+}
+
+size_t explorer_visible_rows() {
+    return std::max(1, (GetScreenHeight() - 3 * EXPLORER_FONT_SIZE - 40) / (EXPLORER_FONT_SIZE + 4));
+}
+
+void explorer_follow_selection(Explorer& explorer) {
+    size_t rows = explorer_visible_rows();
+    if (explorer.selected < explorer.scroll) explorer.scroll = explorer.selected;
+    if (explorer.selected >= explorer.scroll + rows) explorer.scroll = explorer.selected - rows + 1;
+}
+
+// Drawn over the left of the buffer from the last published snapshot only.
+void explorer_draw(const Explorer& explorer) {
+    if (!explorer.visible) return;
+
+    const int lineHeight = EXPLORER_FONT_SIZE + 4;
+    int height = GetScreenHeight() - 2 * EXPLORER_FONT_SIZE;
+    DrawRectangle(0, 0, EXPLORER_WIDTH, height, Fade(BLACK, 0.9f));
+    DrawRectangleLines(0, 0, EXPLORER_WIDTH, height, explorer.focused ? GetColor(0x4388c1ff) : DARKGRAY);
+
+    char line[256];
+    int x = 8;
+    int y = 8;
+    if (explorer.query.empty()) {
+        snprintf(line, sizeof(line), "%s", explorer.scan ? explorer.scan->root.c_str() : "");
+    } else {
+        snprintf(line, sizeof(line), "> %s", explorer.query.c_str());
+    }
+    DrawText(line, x, y, EXPLORER_FONT_SIZE, RAYWHITE);
+    y += lineHeight;
+
+    size_t files = explorer.snapshot ? explorer.snapshot->files : 0;
+    snprintf(line, sizeof(line), explorer_is_scanning(explorer) ? "scanning... %zu files" : "%zu files", files);
+    DrawText(line, x, y, EXPLORER_FONT_SIZE - 2, GRAY);
+    y += lineHeight;
+
+    // Changes in these directories only show up when the explorer is opened again.
+    size_t unwatched = explorer.snapshot ? explorer.snapshot->unwatched : 0;
+    if (unwatched > 0) {
+        snprintf(line, sizeof(line), "%zu %s not watched", unwatched, unwatched == 1 ? "directory" : "directories");
+        DrawText(line, x, y, EXPLORER_FONT_SIZE - 2, GetColor(0xd7a65fff));
+        y += lineHeight;
+    }
+    y += 6;
+
+    size_t last = std::min(explorer_row_count(explorer), explorer.scroll + explorer_visible_rows());
+    for (size_t row = explorer.scroll; row < last; row++) {
+        const ExplorerNode& node = *explorer_row(explorer, row);
+        const char*         path = explorer_node_path(*explorer_row_snapshot(explorer), node);
+        if (row == explorer.selected) {
+            DrawRectangle(2, y - 2, EXPLORER_WIDTH - 4, lineHeight, explorer.focused ? GetColor(0x2c4a66ff) : GetColor(0x333333ff));
+        }
+
+        if (!explorer.query.empty()) {
+            DrawText(path, x, y, EXPLORER_FONT_SIZE, RAYWHITE);
+        } else if (node.directory) {
+            snprintf(line, sizeof(line), "%s %s", explorer.expanded.count(path) > 0 ? "-" : "+", path + node.name);
+            DrawText(line, x + node.depth * 12, y, EXPLORER_FONT_SIZE, GetColor(0x7fb4e0ff));
+        } else {
+            DrawText(path + node.name, x + node.depth * 12 + 12, y, EXPLORER_FONT_SIZE, RAYWHITE);
         }
+        y += lineHeight;
+    }
+}
+
+enum FrameStage {
+    FRAME_POLL,
+    FRAME_EXPLORER,
+    FRAME_COMMAND,
+    FRAME_SEARCH,
+    FRAME_TEXT_INPUT,
+    FRAME_HISTORY,
+    FRAME_MODE,
+    FRAME_CURSOR,
+    FRAME_DRAW,
+    FRAME_OVERLAY,
+    FRAME_PRESENT,
+    FRAME_STAGES
+};
+
+const char* const FRAME_STAGE_NAMES[FRAME_STAGES] = {
+    "poll", "explorer", "command", "search", "text input", "history", "mode", "cursor", "draw", "overlay", "present"
+};
+
+#if defined(DC_COUNT_ALLOCATIONS)
+// Built with `make COUNT_ALLOCATIONS=1`. The count is per thread, so worker threads pay
+// no shared atomic and the profiler sees only what the render thread allocates.
+thread_local size_t frame_allocation_count = 0;
+
+void* operator new(size_t size) {
+    frame_allocation_count++;
+    void* memory = malloc(size == 0 ? 1 : size);
+    if (memory == nullptr) throw std::bad_alloc();
+    return memory;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    free(memory);
+}
+
+size_t frame_allocations() {
+    return frame_allocation_count;
+}
+#endif
+
+// Last frame and p99 over the recorded frames, per stage, in milliseconds.
+void profiler_draw_overlay(const Profiler& profiler) {
+    const ProfileFrame* frame = profiler_last_frame(profiler);
+    if (!profiler.overlay || frame == nullptr) return;
+
+    const int fontSize = 10;
+    const int width    = 260;
+    int x = GetScreenWidth() - width - 10;
+    int y = 10;
+    DrawRectangle(x, y, width, (int)(profiler.stages.size() + 3) * (fontSize + 4) + 8, Fade(BLACK, 0.75f));
+
+    char line[128];
+    x += 6;
+    y += 6;
+    snprintf(line, sizeof(line), "frame %6.2f ms  p99 %6.2f ms", frame->duration / 1e6, profiler_frame_percentile(profiler, 0.99) / 1e6);
+    DrawText(line, x, y, fontSize, RAYWHITE);
+    y += fontSize + 4;
+    if (profiler.countAllocations) {
+        snprintf(line, sizeof(line), "allocations %zu", frame->allocations);
+    } else {
+        snprintf(line, sizeof(line), "allocations not counted");
+    }
+    DrawText(line, x, y, fontSize, RAYWHITE);
+    y += 2 * (fontSize + 4);
+
+    for (size_t stage = 0; stage < profiler.stages.size(); stage++) {
+        snprintf(line, sizeof(line), "%-10s %6.2f ms  p99 %6.2f ms", profiler.stages[stage],
+                 profiler_stage_last(profiler, stage) / 1e6, profiler_stage_percentile(profiler, stage, 0.99) / 1e6);
+        DrawText(line, x, y, fontSize, LIGHTGRAY);
+        y += fontSize + 4;
     }
 }
 
@@ -374,31 +668,56 @@ void close_graphics() {
 void run_editor() {
     initialize_graphics();
 
-    Buffer buffer;
-    buffer_initialize(buffer);
+    Editor editor;
+    editor_initialize(editor);
+    editor_set_glyph_measure(editor, &glyph_advance);
+    profiler_initialize(editor.profiler, FRAME_STAGE_NAMES, FRAME_STAGES);
+#if defined(DC_COUNT_ALLOCATIONS)
+    editor.profiler.countAllocations = &frame_allocations;
+#endif
 
     MiniBuffer miniBuffer;
     mini_buffer_initialize(miniBuffer);
+    editor_open_startup_buffer(editor, miniBuffer.message);
+
+    LineTextureCache lineCache;
+    line_cache_initialize(lineCache);
 
     // INIT Main loop...
-        while (!WindowShouldClose()) {
+        while (!WindowShouldClose() && !editor.quit) {
+            Profiler& profiler = editor.profiler;
+            profiler_begin_frame(profiler);
             BeginDrawing();
-                buffer_handle_text_input(buffer);
-                buffer_handle_mode(buffer);
-                buffer_handle_cursor_movement(buffer);
-                buffer_handle_command(buffer, miniBuffer);
-                buffer_draw(buffer);
-            EndDrawing();
+                { ProfileScope scope(profiler, FRAME_POLL);    editor_poll(editor, miniBuffer.message); }
+                // The explorer goes first, so the Enter that ran ":explore" does not also open a file.
+                bool explorerInput = editor.explorer.focused;
+                { ProfileScope scope(profiler, FRAME_EXPLORER); explorer_handle_input(editor, miniBuffer.message); explorer_follow_selection(editor.explorer); }
+                { ProfileScope scope(profiler, FRAME_COMMAND);  editor_handle_command(editor, miniBuffer); }
+
+                Buffer& buffer = editor_current(editor);
+                buffer_set_viewport(buffer, GetScreenWidth(), GetScreenHeight());
+                { ProfileScope scope(profiler, FRAME_SEARCH); buffer_poll_search(buffer); }
+                if (!explorerInput) {
+                    { ProfileScope scope(profiler, FRAME_TEXT_INPUT); buffer_handle_text_input(buffer); }
+                    { ProfileScope scope(profiler, FRAME_HISTORY);    buffer_handle_history(buffer); }
+                    { ProfileScope scope(profiler, FRAME_SEARCH);     buffer_handle_search(buffer, miniBuffer); }
+                    { ProfileScope scope(profiler, FRAME_MODE);       buffer_handle_mode(buffer); }
+                    { ProfileScope scope(profiler, FRAME_CURSOR);     buffer_handle_cursor_movement(buffer); buffer_follow_cursor(buffer); }
+                }
+                { ProfileScope scope(profiler, FRAME_DRAW);       buffer_draw(buffer, lineCache); explorer_draw(editor.explorer); buffer_draw_mini_buffer(buffer, miniBuffer); }
+                { ProfileScope scope(profiler, FRAME_OVERLAY);    profiler_draw_overlay(profiler); }
+            { ProfileScope scope(profiler, FRAME_PRESENT); EndDrawing(); }
+            profiler_end_frame(profiler);
         }
     // END Main loop.
 
+    line_cache_unload(lineCache);
+    editor_close(editor);
     close_graphics();
 }
 
 int main() {
     // @TODO: CRUD OF FILES...
-    // @TODO: FILE TREE or FILE EXPLORER...
-    // @TODO: MUST HAVE AN ARRAY OF EDITORS...
     run_editor();
     return 0;
 }
@@ -0,0 +1,101 @@
+#include "glyph_renderer.hpp"
+#include "../../vendor/raylib/include/rlgl.h"
+
+#include <cmath>
+
+// Mirrors the placement DrawText uses (DrawTextCodepoint at scale fontSize / baseSize),
+// so both paths put the same pixels on screen.
+void glyph_atlas_build(GlyphAtlas& atlas, Font font, int fontSize) {
+    float scale = (float)fontSize / font.baseSize;
+
+    atlas.texture     = font.texture;
+    atlas.fontSize    = fontSize;
+    atlas.monospace   = true;
+    atlas.cellAdvance = -1;
+
+    for (int code = 0; code < 256; code++) {
+        GlyphQuad& quad = atlas.quads[code];
+        int        idx  = GetGlyphIndex(font, code < 128 ? code : '?');
+        Rectangle  rec  = font.recs[idx];
+        float      pad  = (float)font.glyphPadding;
+
+        quad.u0      = (rec.x - pad) / font.texture.width;
+        quad.v0      = (rec.y - pad) / font.texture.height;
+        quad.u1      = (rec.x + rec.width + pad) / font.texture.width;
+        quad.v1      = (rec.y + rec.height + pad) / font.texture.height;
+        quad.offsetX = (font.glyphs[idx].offsetX - pad) * scale;
+        quad.offsetY = (font.glyphs[idx].offsetY - pad) * scale;
+        quad.width   = (rec.width + 2 * pad) * scale;
+        quad.height  = (rec.height + 2 * pad) * scale;
+        quad.visible = code > ' ';
+
+        float advance = font.glyphs[idx].advanceX == 0 ? rec.width : font.glyphs[idx].advanceX;
+        atlas.advances[code] = advance * scale;
+        if (code >= ' ' && code < 127) {
+            if (atlas.cellAdvance < 0) atlas.cellAdvance = atlas.advances[code];
+            atlas.monospace = atlas.monospace && atlas.advances[code] == atlas.cellAdvance;
+        }
+    }
+}
+
+// Every quad between begin and end lands in the same rlgl draw call; rlgl flushes on
+// its own when the vertex buffer fills up.
+void glyph_batch_begin(const GlyphAtlas& atlas, Color color) {
+    rlSetTexture(atlas.texture.id);
+    rlBegin(RL_QUADS);
+    rlColor4ub(color.r, color.g, color.b, color.a);
+    rlNormal3f(0.0f, 0.0f, 1.0f);
+}
+
+void glyph_batch_end() {
+    rlEnd();
+    rlSetTexture(0);
+}
+
+// Applies to the quads that follow, so a highlighted line is still one batch.
+void glyph_batch_color(Color color) {
+    rlColor4ub(color.r, color.g, color.b, color.a);
+}
+
+void glyph_batch_quad(const GlyphAtlas& atlas, char c, float x, float y) {
+    const GlyphQuad& quad = atlas.quads[(unsigned char)c];
+    if (!quad.visible) return;
+
+    float left   = std::floor(x) + quad.offsetX;
+    float top    = std::floor(y) + quad.offsetY;
+    float right  = left + quad.width;
+    float bottom = top + quad.height;
+
+    rlTexCoord2f(quad.u0, quad.v0); rlVertex2f(left,  top);
+    rlTexCoord2f(quad.u0, quad.v1); rlVertex2f(left,  bottom);
+    rlTexCoord2f(quad.u1, quad.v1); rlVertex2f(right, bottom);
+    rlTexCoord2f(quad.u1, quad.v0); rlVertex2f(right, top);
+}
+
+void glyph_draw_placed(const GlyphAtlas& atlas, const Vector<PlacedGlyph>& glyphs, float x, float y, Color color) {
+    glyph_batch_begin(atlas, color);
+    for (const PlacedGlyph& placed : glyphs) {
+        glyph_batch_quad(atlas, placed.c, x + placed.x, y);
+    }
+    glyph_batch_end();
+}
+
+// Draws a run of bytes with the atlas advances plus `spacing` and returns the pen position
+// after it. Monospaced atlases skip the advance table altogether.
+float glyph_draw_text(const GlyphAtlas& atlas, const char* data, size_t length, float x, float y, float spacing, Color color) {
+    glyph_batch_begin(atlas, color);
+    if (atlas.monospace) {
+        float step = atlas.cellAdvance + spacing;
+        for (size_t idx = 0; idx < length; idx++) {
+            glyph_batch_quad(atlas, data[idx], x + idx * step, y);
+        }
+        x += length * step;
+    } else {
+        for (size_t idx = 0; idx < length; idx++) {
+            glyph_batch_quad(atlas, data[idx], x, y);
+            x += atlas.advances[(unsigned char)data[idx]] + spacing;
+        }
+    }
+    glyph_batch_end();
+    return x;
+}
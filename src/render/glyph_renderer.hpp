@@ -0,0 +1,35 @@
+#pragma once
+
+#include "../../vendor/raylib/include/raylib.h"
+#include "../core/buffer.hpp"
+
+// Where one byte is in the font texture and where its quad goes relative to the pen
+// position, already scaled to the atlas size.
+struct GlyphQuad {
+    float                u0, v0, u1, v1;
+    float                offsetX;
+    float                offsetY;
+    float                width;
+    float                height;
+    bool                 visible;
+};
+
+// Quads and advances of a font at one size for every byte, computed once so drawing a
+// glyph is a table lookup instead of DrawText's string walk and glyph search. The
+// texture is the font's own packed atlas.
+struct GlyphAtlas {
+    Texture2D            texture;
+    int                  fontSize;
+    GlyphQuad            quads[256];
+    float                advances[256];
+    bool                 monospace;
+    float                cellAdvance;
+};
+
+void  glyph_atlas_build(GlyphAtlas& atlas, Font font, int fontSize);
+void  glyph_batch_begin(const GlyphAtlas& atlas, Color color);
+void  glyph_batch_end();
+void  glyph_batch_color(Color color);
+void  glyph_batch_quad(const GlyphAtlas& atlas, char c, float x, float y);
+void  glyph_draw_placed(const GlyphAtlas& atlas, const Vector<PlacedGlyph>& glyphs, float x, float y, Color color);
+float glyph_draw_text(const GlyphAtlas& atlas, const char* data, size_t length, float x, float y, float spacing, Color color);